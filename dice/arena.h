@@ -0,0 +1,80 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <memory_resource>
+
+//memory_resource in front of another one that counts what goes through it: allocations, frees, bytes and the peak of live bytes.
+//Thread safe when upstream is
+class AllocationCounter : public std::pmr::memory_resource
+{
+    public:
+    explicit AllocationCounter(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource()) : upstream(upstream) {}
+
+    std::atomic<long> allocations{0};
+    std::atomic<long> frees{0};
+    std::atomic<size_t> bytes{0};      //every allocation, frees don't subtract
+    std::atomic<size_t> live_bytes{0};
+    std::atomic<size_t> peak_bytes{0};
+
+    private:
+    std::pmr::memory_resource* upstream;
+
+    void* do_allocate(size_t size, size_t alignment) override
+    {
+        void* memory = upstream->allocate(size, alignment);
+        allocations++;
+        bytes += size;
+        size_t live = live_bytes += size;
+        size_t peak = peak_bytes;
+        while(live > peak && !peak_bytes.compare_exchange_weak(peak, live)) {}
+        return memory;
+    }
+
+    void do_deallocate(void* memory, size_t size, size_t alignment) override
+    {
+        upstream->deallocate(memory, size, alignment);
+        frees++;
+        live_bytes -= size;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+//Monotonic arena for the geometry of one load: arrays are carved out of a few growing blocks, freeing
+//them does nothing, and release() gives every block back at once. One thread at a time.
+//requests counts what the arrays asked for, a free before release() means an array was reallocated (or dropped);
+//blocks counts what the arena took from the heap.
+//The temporaries of parsing, optimizing and simplifying come from scratch instead, a pool whose freed blocks
+//are reused by the next temporary. It is thread safe, the parse jobs share it
+class LoadArena
+{
+    public:
+    AllocationCounter blocks;
+    std::pmr::monotonic_buffer_resource arena;
+    AllocationCounter requests;
+    AllocationCounter scratch_blocks;
+    std::pmr::synchronized_pool_resource scratch_pool;
+    AllocationCounter scratch;
+
+    explicit LoadArena(size_t first_block = 64 * 1024)
+        : arena(first_block, &blocks), requests(&arena), scratch_pool(&scratch_blocks), scratch(&scratch_pool) {}
+
+    std::pmr::memory_resource* resource() { return &requests; }
+    std::pmr::memory_resource* scratch_resource() { return &scratch; }
+
+    //everything allocated from it must be gone or never touched again
+    void release()
+    {
+        arena.release();
+        scratch_pool.release();
+    }
+};
@@ -0,0 +1,48 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <vector>
+#include "mesh_pool.h"
+#include "render_queue.h"
+
+//A recorded draw: the state it needs and the indirect command to run, whose base_instance is the
+//offset of its per instance data in the frame's instance ring slice
+struct DrawPacket
+{
+    RenderItem state; //first_command/command_count are filled in at replay
+    DrawElementsIndirectCommand command;
+};
+
+//Plain list of draw packets. Recording makes no GL calls, so any thread can fill one; only replay()
+//has to run on the GL thread
+class CommandList
+{
+    public:
+    std::vector<DrawPacket> packets;
+
+    void clear()
+    {
+        packets.clear();
+    }
+
+    void draw(const RenderItem &state, const DrawElementsIndirectCommand &command)
+    {
+        DrawPacket packet = { state, command };
+        packets.push_back(packet);
+    }
+};
+
+//Turns the packets into this frame's pool commands and queues them, in recording order
+inline void replay(const CommandList &list, MeshPool &pool, RenderQueue &queue, float depth_range)
+{
+    for(size_t i = 0; i < list.packets.size(); i++) {
+        RenderItem item = list.packets[i].state;
+        item.first_command = pool.add_frame_command(list.packets[i].command);
+        item.command_count = 1;
+        queue.add(item, depth_range);
+    }
+}
@@ -0,0 +1,637 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <string.h>
+#include <condition_variable>
+#include <GL/glew.h>
+#include "stb/stb_image.h"
+#include "stb/stb_image_resize.h"
+#include "jobs.h"
+#include "dxt.h"
+#include "mesh_cache.h"
+
+//Cubemap face images, in GL_TEXTURE_CUBE_MAP_POSITIVE_X + face order
+const char* const cube_face_names[6] = { "right", "left", "top", "bottom", "front", "back" };
+
+//Bytes of faces the streamer copies into a pixel buffer and uploads per update()
+const size_t CUBEMAP_UPLOAD_BYTES = 1 << 20;
+
+//Levels of a full mip chain down to 1x1
+inline int cube_mip_levels(int width, int height)
+{
+    int levels = 1;
+    while((std::max(width, height) >> levels) > 0) levels++;
+    return levels;
+}
+
+//The six faces of a cubemap and their mips in one staging allocation, face f of level l at face(f, l).
+//Level after level, so level 0 stays where it is when the mips are added. Decoding into it again only
+//reallocates when the new faces are bigger
+struct CubemapFaces
+{
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    int levels = 1;
+    std::vector<unsigned char> pixels;
+
+    int level_width(int level) const { return std::max(1, width >> level); }
+    int level_height(int level) const { return std::max(1, height >> level); }
+    size_t face_bytes(int level = 0) const { return (size_t)level_width(level) * level_height(level) * channels; }
+    size_t level_offset(int level) const
+    {
+        size_t offset = 0;
+        for(int l = 0; l < level; l++) offset += 6 * face_bytes(l);
+        return offset;
+    }
+    unsigned char* face(int f, int level = 0) { return &pixels[0] + level_offset(level) + f * face_bytes(level); }
+    const unsigned char* face(int f, int level = 0) const { return &pixels[0] + level_offset(level) + f * face_bytes(level); }
+};
+
+inline std::string cube_face_path(const char* dir, int face)
+{
+    return std::string(dir) + cube_face_names[face] + ".jpg";
+}
+
+inline GLenum cube_face_format(int channels)
+{
+    const GLenum formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    return formats[channels - 1];
+}
+
+//The faces are sRGB and so are their textures, so sampling and trilinear filtering happen in linear light.
+//One and two channel faces have no sRGB format
+inline GLenum cube_face_internal_format(int channels)
+{
+    const GLenum formats[4] = { GL_R8, GL_RG8, GL_SRGB8, GL_SRGB8_ALPHA8 };
+    return formats[channels - 1];
+}
+
+//Samples of the sRGB cubemaps come back linear and the framebuffer isn't sRGB, so the shaders encode what they write
+#define SRGB_ENCODE_GLSL \
+"vec3 srgb_encode(vec3 linear) {" \
+"	return mix(linear * 12.92, 1.055 * pow(linear, vec3(1.0 / 2.4)) - 0.055, step(0.0031308, linear));" \
+"}"
+
+//Reads only the six headers: they have to share one size and channel count, then faces is sized for them,
+//with room for a full mip chain when mips is set. channels 0 keeps the ones in the files
+inline bool prepare_cube_faces(const char* dir, int channels, CubemapFaces &faces, bool mips = false)
+{
+    int width = 0, height = 0, comp = 0;
+    for(int face = 0; face < 6; face++) {
+        int w, h, c;
+        if(!stbi_info(cube_face_path(dir, face).c_str(), &w, &h, &c)) {
+            std::cerr << "Failed to load " << cube_face_names[face] << " texture.\n";
+            return false;
+        }
+        if(face == 0) {
+            width = w;
+            height = h;
+            comp = c;
+        } else if(w != width || h != height || c != comp) {
+            std::cerr << cube_face_path(dir, face) << " is " << w << "x" << h << " with " << c << " channels, "
+                << cube_face_path(dir, 0) << " is " << width << "x" << height << " with " << comp << ".\n";
+            return false;
+        }
+    }
+    faces.width = width;
+    faces.height = height;
+    faces.channels = channels != 0 ? channels : comp;
+    faces.levels = mips ? cube_mip_levels(width, height) : 1;
+    faces.pixels.resize(faces.level_offset(faces.levels));
+    return true;
+}
+
+//Level 1 and down of one face, each one from the one above. Filtered in linear light (the faces are sRGB),
+//so the mips don't get darker than the face. No GL
+inline void generate_face_mips(CubemapFaces &faces, int face)
+{
+    int alpha = faces.channels == 4 ? 3 : STBIR_ALPHA_CHANNEL_NONE;
+    for(int level = 1; level < faces.levels; level++) {
+        stbir_resize_uint8_srgb(faces.face(face, level - 1), faces.level_width(level - 1), faces.level_height(level - 1), 0,
+            faces.face(face, level), faces.level_width(level), faces.level_height(level), 0, faces.channels, alpha, 0);
+    }
+}
+
+//Decodes one face into its place in faces (after prepare_cube_faces), no GL so it can run on a job thread
+inline bool decode_cube_face(const char* dir, int face, CubemapFaces &faces)
+{
+    int width, height, comp;
+    unsigned char* pixels = stbi_load(cube_face_path(dir, face).c_str(), &width, &height, &comp, faces.channels);
+    if(!pixels || width != faces.width || height != faces.height) { //the file could have changed since its header was read
+        std::cerr << "Failed to load " << cube_face_names[face] << " texture.\n";
+        if(pixels) stbi_image_free(pixels);
+        return false;
+    }
+    memcpy(faces.face(face), pixels, faces.face_bytes());
+    stbi_image_free(pixels);
+    return true;
+}
+
+//All six faces (and their mips), one per job when jobs isn't NULL. Nothing is decoded unless the headers all match
+inline bool decode_cube_faces(const char* dir, int channels, JobSystem* jobs, CubemapFaces &faces, bool mips = false)
+{
+    if(!prepare_cube_faces(dir, channels, faces, mips)) return false;
+    bool ok[6];
+    std::function<void(int)> job = [&](int face) {
+        ok[face] = decode_cube_face(dir, face, faces);
+        if(ok[face]) generate_face_mips(faces, face);
+    };
+    if(jobs != NULL) jobs->run(6, job);
+    else for(int face = 0; face < 6; face++) job(face);
+    return ok[0] && ok[1] && ok[2] && ok[3] && ok[4] && ok[5];
+}
+
+//Uploads a decoded face and its mips into the bound cubemap
+inline void upload_cube_face(int face, const CubemapFaces &faces)
+{
+    GLenum format = cube_face_format(faces.channels);
+    GLenum internal_format = cube_face_internal_format(faces.channels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(int level = 0; level < faces.levels; level++) {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, internal_format, faces.level_width(level), faces.level_height(level), 0, format, GL_UNSIGNED_BYTE, faces.face(face, level));
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+//Filtering of the bound cubemap, trilinear when it has mips
+inline void set_cube_filtering(int levels)
+{
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+}
+
+//Decodes the six faces and their mips (in parallel with jobs) into staging and uploads them, 0 when one of them can't be loaded
+inline GLuint load_cube_tex(const char* dir, int channels, JobSystem* jobs, CubemapFaces &staging)
+{
+    if(!decode_cube_faces(dir, channels, jobs, staging, true)) {
+        return 0;
+    }
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+    for(int face = 0; face < 6; face++) {
+        upload_cube_face(face, staging);
+    }
+    set_cube_filtering(staging.levels);
+    return texture;
+}
+
+//Block compressed faces (dxt.h), BC1 from RGB and BC3 from RGBA, laid out like CubemapFaces: face f of
+//level l at face(f, l). Rows are rows of 4x4 blocks, the mips smaller than a block still take one
+struct CompressedCubemap
+{
+    int width = 0;
+    int height = 0;
+    int levels = 1;
+    GLenum format = 0; //0 when there is nothing compressed
+    std::vector<unsigned char> data;
+
+    int level_width(int level) const { return std::max(1, width >> level); }
+    int level_height(int level) const { return std::max(1, height >> level); }
+    int blocks_x(int level = 0) const { return (level_width(level) + 3) / 4; }
+    int blocks_y(int level = 0) const { return (level_height(level) + 3) / 4; }
+    size_t block_bytes() const { return format == GL_COMPRESSED_SRGB_S3TC_DXT1_EXT ? 8 : 16; }
+    size_t row_bytes(int level = 0) const { return blocks_x(level) * block_bytes(); }
+    size_t face_bytes(int level = 0) const { return row_bytes(level) * blocks_y(level); }
+    size_t level_offset(int level) const
+    {
+        size_t offset = 0;
+        for(int l = 0; l < level; l++) offset += 6 * face_bytes(l);
+        return offset;
+    }
+    unsigned char* face(int f, int level = 0) { return &data[0] + level_offset(level) + f * face_bytes(level); }
+    const unsigned char* face(int f, int level = 0) const { return &data[0] + level_offset(level) + f * face_bytes(level); }
+};
+
+//Only RGB and RGBA faces are compressed
+inline bool cube_faces_compressible(const CubemapFaces &faces)
+{
+    return faces.channels == 3 || faces.channels == 4;
+}
+
+//Sizes compressed for faces (after prepare_cube_faces)
+inline void prepare_compressed_cubemap(const CubemapFaces &faces, CompressedCubemap &compressed)
+{
+    compressed.width = faces.width;
+    compressed.height = faces.height;
+    compressed.levels = faces.levels;
+    compressed.format = faces.channels == 4 ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_SRGB_S3TC_DXT1_EXT; //sRGB like the faces
+    compressed.data.resize(compressed.level_offset(compressed.levels));
+}
+
+//Compresses the block rows [first_row, first_row + rows) of one face of one level, no GL so it can run on a job thread
+inline void compress_cube_rows(const CubemapFaces &faces, int face, int level, int first_row, int rows, DxtEncoder encoder, CompressedCubemap &compressed)
+{
+    bool alpha = faces.channels == 4;
+    DxtBlock block;
+    for(int y = first_row; y < first_row + rows; y++) {
+        unsigned char* dest = compressed.face(face, level) + y * compressed.row_bytes(level);
+        for(int x = 0; x < compressed.blocks_x(level); x++) {
+            dxt_load_block(faces.face(face, level), faces.level_width(level), faces.level_height(level), faces.channels, x * 4, y * 4, block);
+            dxt_compress_block(dest + x * compressed.block_bytes(), block, alpha, encoder);
+        }
+    }
+}
+
+//Every level of one face
+inline void compress_cube_face(const CubemapFaces &faces, int face, DxtEncoder encoder, CompressedCubemap &compressed)
+{
+    for(int level = 0; level < faces.levels; level++) {
+        compress_cube_rows(faces, face, level, 0, compressed.blocks_y(level), encoder, compressed);
+    }
+}
+
+//All six faces and their mips, one row of blocks per job when jobs isn't NULL
+inline void compress_cube_faces(const CubemapFaces &faces, DxtEncoder encoder, JobSystem* jobs, CompressedCubemap &compressed)
+{
+    prepare_compressed_cubemap(faces, compressed);
+    if(jobs == NULL) {
+        for(int face = 0; face < 6; face++) compress_cube_face(faces, face, encoder, compressed);
+        return;
+    }
+    std::vector<int> first_rows(compressed.levels + 1, 0); //job index of the first row of each level
+    for(int level = 0; level < compressed.levels; level++) {
+        first_rows[level + 1] = first_rows[level] + 6 * compressed.blocks_y(level);
+    }
+    std::function<void(int)> job = [&](int row) {
+        int level = std::upper_bound(first_rows.begin(), first_rows.end(), row) - first_rows.begin() - 1;
+        int rows = compressed.blocks_y(level);
+        row -= first_rows[level];
+        compress_cube_rows(faces, row / rows, level, row % rows, 1, encoder, compressed);
+    };
+    jobs->run(first_rows.back(), job);
+}
+
+//Uploads a compressed face and its mips into the bound cubemap
+inline void upload_compressed_face(int face, const CompressedCubemap &compressed)
+{
+    for(int level = 0; level < compressed.levels; level++) {
+        glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, compressed.format, compressed.level_width(level), compressed.level_height(level), 0,
+            compressed.face_bytes(level), compressed.face(face, level));
+    }
+}
+
+//Compressed faces next to the source faces (skybox/ -> skybox/cubemap.dxtcache), so later launches skip the
+//decoding, the mips and the compression. Layout: DxtCacheHeader, then the six faces of each level.
+//The cache is rebuilt when the version or the size or hash of the JPEGs don't match
+const uint32_t DXT_CACHE_VERSION = 3;
+
+struct DxtCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;
+    uint64_t source_size;
+    uint64_t source_hash;
+};
+
+inline std::string dxt_cache_path(const char* dir)
+{
+    return std::string(dir) + "cubemap.dxtcache";
+}
+
+//Total size and combined hash of the six face files, false when one can't be read
+inline bool hash_cube_faces(const char* dir, uint64_t &size, uint64_t &hash)
+{
+    size = 0;
+    hash = 14695981039346656037ull;
+    for(int face = 0; face < 6; face++) {
+        MappedFile source;
+        if(!source.open(cube_face_path(dir, face))) return false;
+        size += source.size;
+        hash = (hash ^ hash_bytes(source.data, source.size)) * 1099511628211ull;
+        source.close();
+    }
+    return true;
+}
+
+//false when there is no cache for dir or it is out of date
+inline bool read_dxt_cache(const char* dir, CompressedCubemap &compressed)
+{
+    uint64_t source_size, source_hash;
+    MappedFile cache;
+    if(!hash_cube_faces(dir, source_size, source_hash) || !cache.open(dxt_cache_path(dir)) || cache.size < sizeof(DxtCacheHeader)) {
+        return false;
+    }
+    DxtCacheHeader header;
+    memcpy(&header, cache.data, sizeof(header));
+    compressed.width = header.width;
+    compressed.height = header.height;
+    compressed.levels = header.levels;
+    compressed.format = header.format;
+    bool valid = memcmp(header.magic, "DDXT", 4) == 0 && header.version == DXT_CACHE_VERSION && header.source_size == source_size
+        && header.source_hash == source_hash && (header.format == GL_COMPRESSED_SRGB_S3TC_DXT1_EXT || header.format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT)
+        && header.width > 0 && header.height > 0 && header.levels >= 1 && (int)header.levels <= cube_mip_levels(header.width, header.height)
+        && cache.size == sizeof(header) + compressed.level_offset(compressed.levels);
+    if(valid) {
+        compressed.data.assign(cache.data + sizeof(header), cache.data + cache.size);
+    } else {
+        compressed.format = 0;
+    }
+    cache.close();
+    return valid;
+}
+
+//Written to a temporary file first so a crash never leaves a half written cache behind
+inline void write_dxt_cache(const char* dir, const CompressedCubemap &compressed)
+{
+    DxtCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "DDXT", 4);
+    header.version = DXT_CACHE_VERSION;
+    header.format = compressed.format;
+    header.width = compressed.width;
+    header.height = compressed.height;
+    header.levels = compressed.levels;
+    if(!hash_cube_faces(dir, header.source_size, header.source_hash)) {
+        return;
+    }
+    std::string cache_file = dxt_cache_path(dir);
+    std::string temporary = cache_file + ".tmp";
+    FILE* f = fopen(temporary.c_str(), "wb");
+    if(f == NULL) {
+        std::cerr << "Can't write texture cache " << cache_file << "\n";
+        return;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(compressed.data.data(), 1, compressed.data.size(), f) == compressed.data.size();
+    written = fclose(f) == 0 && written;
+    if(!written || rename(temporary.c_str(), cache_file.c_str()) != 0) {
+        std::cerr << "Can't write texture cache " << cache_file << "\n";
+        remove(temporary.c_str());
+    }
+}
+
+//One cubemap on its way through the streamer
+struct CubemapStream
+{
+    std::string dir;
+    bool show = false; //false for prefetches
+    bool ok = false;   //every face decoded, with the same size
+    CubemapFaces faces;
+    CompressedCubemap compressed; //what gets uploaded when it has a format, instead of faces
+    bool from_cache = false;
+    GLuint texture = 0;
+    int level = 0; //upload position
+    int face = 0;
+    int row = 0;
+};
+
+//Loads cubemaps without stalling the render loop. A thread of its own decodes the faces (the job threads
+//are busy recording frames), then the GL thread streams them in through a pixel buffer, upload_bytes per update().
+//The cubemap is only handed over once every face is in, so whatever is bound until then stays bound.
+//The staging allocation goes back and forth between the decoder and the uploads instead of being freed.
+//With compress the decoder also block compresses the faces, or reads them from the dxt cache when it is up to date
+class CubemapStreamer
+{
+    public:
+    size_t upload_bytes = CUBEMAP_UPLOAD_BYTES;
+    bool compress = false; //set before start()
+    DxtEncoder encoder = dxt_widest_encoder();
+    std::function<void()> on_decoded; //called on the decoder thread when a cubemap is ready to upload, set before start()
+
+    ~CubemapStreamer() { stop(); }
+
+    //Hands over a staging allocation (e.g. the one startup decoded into) for the next decode to reuse
+    void reuse(CubemapFaces &faces)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        keep_spare(faces.pixels);
+    }
+
+    void start()
+    {
+        decoder = std::thread(&CubemapStreamer::decode_loop, this);
+    }
+
+    //Queues dir unless it is already on its way, a prefetch that gets requested for real becomes shown
+    void request(const std::string &dir, bool show)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(uploading && current.dir == dir) {
+                current.show = current.show || show;
+                return;
+            }
+            for(std::deque<CubemapStream>::iterator it = queued.begin(); it != queued.end(); ++it) {
+                if(it->dir == dir) {
+                    it->show = it->show || show;
+                    return;
+                }
+            }
+            for(std::deque<CubemapStream>::iterator it = decoded.begin(); it != decoded.end(); ++it) {
+                if(it->dir == dir) {
+                    it->show = it->show || show;
+                    return;
+                }
+            }
+            if(decoding == dir) {
+                decoding_show = decoding_show || show;
+                return;
+            }
+            CubemapStream stream;
+            stream.dir = dir;
+            stream.show = show;
+            queued.push_back(stream);
+        }
+        wake.notify_one();
+    }
+
+    //Whether update() has GL work to do. While one is only being decoded there is none, on_decoded tells when there is
+    bool has_gl_work()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return uploading || !decoded.empty();
+    }
+
+    //GL thread, once per loop iteration. Uploads up to upload_bytes of the cubemap in flight, and returns true
+    //when one is done: finished.texture is then the caller's (0 when ok is false)
+    bool update(CubemapStream &finished)
+    {
+        if(!uploading) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(decoded.empty()) return false;
+                current = std::move(decoded.front());
+                decoded.pop_front();
+                uploading = true;
+            }
+            if(!current.ok) {
+                return finish(finished);
+            }
+            glGenTextures(1, &current.texture);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, current.texture);
+            const CompressedCubemap &compressed = current.compressed;
+            const CubemapFaces &faces = current.faces;
+            GLenum format = cube_face_format(faces.channels);
+            GLenum internal_format = cube_face_internal_format(faces.channels);
+            int levels = compressed.format != 0 ? compressed.levels : faces.levels;
+            for(int level = 0; level < levels; level++) {
+                for(int face = 0; face < 6; face++) {
+                    GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
+                    if(compressed.format != 0) {
+                        glCompressedTexImage2D(target, level, compressed.format, compressed.level_width(level), compressed.level_height(level), 0, compressed.face_bytes(level), NULL);
+                    } else {
+                        glTexImage2D(target, level, internal_format, faces.level_width(level), faces.level_height(level), 0, format, GL_UNSIGNED_BYTE, NULL);
+                    }
+                }
+            }
+            set_cube_filtering(levels);
+            if(pixel_buffer == 0) glGenBuffers(1, &pixel_buffer);
+        }
+
+        glBindTexture(GL_TEXTURE_CUBE_MAP, current.texture);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        //rows of pixels, or of blocks when compressed, level after level
+        const CubemapFaces &faces = current.faces;
+        const CompressedCubemap &compressed = current.compressed;
+        bool blocks = compressed.format != 0;
+        int levels = blocks ? compressed.levels : faces.levels;
+        size_t budget = upload_bytes;
+        while(budget > 0 && current.level < levels) {
+            int level = current.level;
+            size_t row_bytes = blocks ? compressed.row_bytes(level) : (size_t)faces.level_width(level) * faces.channels;
+            int row_count = blocks ? compressed.blocks_y(level) : faces.level_height(level);
+            int rows = std::min(row_count - current.row, (int)std::max((size_t)1, budget / row_bytes));
+            size_t bytes = rows * row_bytes;
+            const unsigned char* source = (blocks ? compressed.face(current.face, level) : faces.face(current.face, level)) + current.row * row_bytes;
+            //orphaned every time, so the copy never waits for the previous transfer
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+            void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if(mapped != NULL) {
+                memcpy(mapped, source, bytes);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + current.face;
+                if(blocks) {
+                    int y = current.row * 4;
+                    glCompressedTexSubImage2D(target, level, 0, y, compressed.level_width(level), std::min(rows * 4, compressed.level_height(level) - y),
+                        compressed.format, bytes, (void*)0);
+                } else {
+                    glTexSubImage2D(target, level, 0, current.row, faces.level_width(level), rows, cube_face_format(faces.channels), GL_UNSIGNED_BYTE, (void*)0);
+                }
+            }
+            current.row += rows;
+            budget -= std::min(budget, bytes);
+            if(current.row == row_count) {
+                current.row = 0;
+                if(++current.face == 6) {
+                    current.face = 0;
+                    current.level++;
+                }
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if(current.level < levels) return false;
+        return finish(finished);
+    }
+
+    //Joins the decoder and frees whatever wasn't uploaded, no GL
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_one();
+        if(decoder.joinable()) decoder.join();
+        decoded.clear();
+        queued.clear();
+        current.faces.pixels.clear();
+        std::vector<unsigned char>().swap(spare);
+    }
+
+    void destroy()
+    {
+        stop();
+        if(uploading && current.texture != 0) glDeleteTextures(1, &current.texture);
+        if(pixel_buffer != 0) glDeleteBuffers(1, &pixel_buffer);
+        uploading = false;
+        pixel_buffer = 0;
+    }
+
+    private:
+    std::thread decoder;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<CubemapStream> queued;
+    std::deque<CubemapStream> decoded;
+    std::string decoding; //dir the decoder is on, empty when idle
+    bool decoding_show = false;
+    bool quit = false;
+    std::vector<unsigned char> spare; //staging of the last upload, the next decode reuses it
+    CubemapStream current; //GL thread only
+    bool uploading = false;
+    GLuint pixel_buffer = 0;
+
+    bool finish(CubemapStream &finished)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        keep_spare(current.faces.pixels);
+        finished = std::move(current);
+        current = CubemapStream();
+        uploading = false;
+        return true;
+    }
+
+    //The bigger of pixels and spare becomes the spare, pixels ends up empty. With the mutex held
+    void keep_spare(std::vector<unsigned char> &pixels)
+    {
+        if(pixels.capacity() > spare.capacity()) spare.swap(pixels);
+        pixels.clear();
+    }
+
+    void decode_loop()
+    {
+        while(true) {
+            CubemapStream stream;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return quit || !queued.empty(); });
+                if(quit) return;
+                stream = std::move(queued.front());
+                queued.pop_front();
+                decoding = stream.dir;
+                decoding_show = stream.show;
+                stream.faces.pixels.swap(spare);
+            }
+            //one face after the other, the job threads are recording frames
+            const char* dir = stream.dir.c_str();
+            if(compress && read_dxt_cache(dir, stream.compressed)) {
+                stream.ok = stream.from_cache = true;
+            } else {
+                stream.ok = decode_cube_faces(dir, 3, NULL, stream.faces, true);
+                if(stream.ok && compress) {
+                    compress_cube_faces(stream.faces, encoder, NULL, stream.compressed);
+                    write_dxt_cache(dir, stream.compressed);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(!stream.ok || stream.compressed.format != 0) keep_spare(stream.faces.pixels);
+                stream.show = stream.show || decoding_show;
+                decoding.clear();
+                decoded.push_back(std::move(stream));
+            }
+            if(on_decoded) on_decoded();
+        }
+    }
+};
@@ -0,0 +1,196 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "glm/glm.hpp"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+//Six planes, a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all of them
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+//Gribb/Hartmann plane extraction from a projection * view matrix, so the planes are in world space
+inline Frustum extract_frustum(const glm::mat4 &m)
+{
+    //glm is column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    glm::vec4 rows[4];
+    for(int i = 0; i < 4; i++) {
+        rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    }
+    Frustum frustum;
+    for(int i = 0; i < 3; i++) {
+        frustum.planes[2 * i] = rows[3] + rows[i];
+        frustum.planes[2 * i + 1] = rows[3] - rows[i];
+    }
+    for(int i = 0; i < 6; i++) {
+        frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+    }
+    return frustum;
+}
+
+//World space bounding sphere and AABB of every object, one array per component so the
+//kernels can load 4 (SSE) or 8 (AVX) objects at a time
+class CullSet
+{
+    public:
+    std::vector<float> center_x, center_y, center_z, radius;
+    std::vector<float> min_x, min_y, min_z, max_x, max_y, max_z;
+
+    void resize(size_t count)
+    {
+        std::vector<float>* arrays[10] = { &center_x, &center_y, &center_z, &radius, &min_x, &min_y, &min_z, &max_x, &max_y, &max_z };
+        for(int i = 0; i < 10; i++) {
+            arrays[i]->resize(count);
+        }
+    }
+
+    size_t size() const { return radius.size(); }
+
+    //Bounds of a mesh whose local AABB is [local_min, local_max], placed by world
+    void set(size_t i, const glm::mat4 &world, const glm::vec3 &local_min, const glm::vec3 &local_max)
+    {
+        glm::vec3 local_center = (local_min + local_max) * 0.5f;
+        glm::vec3 local_extent = (local_max - local_min) * 0.5f;
+        glm::vec3 center = glm::vec3(world * glm::vec4(local_center, 1.0f));
+        //Arvo: the world extent along each axis is the sum of the absolute rotated extents
+        glm::vec3 extent(0.0f);
+        float max_scale = 0.0f;
+        for(int c = 0; c < 3; c++) {
+            glm::vec3 axis = glm::vec3(world[c]);
+            extent += glm::abs(axis) * local_extent[c];
+            max_scale = glm::max(max_scale, glm::length(axis));
+        }
+        center_x[i] = center.x;
+        center_y[i] = center.y;
+        center_z[i] = center.z;
+        radius[i] = glm::length(local_extent) * max_scale;
+        min_x[i] = center.x - extent.x;
+        min_y[i] = center.y - extent.y;
+        min_z[i] = center.z - extent.z;
+        max_x[i] = center.x + extent.x;
+        max_y[i] = center.y + extent.y;
+        max_z[i] = center.z + extent.z;
+    }
+};
+
+//Each kernel tests objects [first, first + count) against the frustum and writes the indices of the visible
+//ones to visible (room for count entries), returning how many there are. An object is visible when its
+//sphere and its AABB (nearest corner along each plane normal) are both on the inner side of every plane.
+
+inline bool cull_test_one(const Frustum &frustum, const CullSet &set, size_t i)
+{
+    for(int p = 0; p < 6; p++) {
+        const glm::vec4 &plane = frustum.planes[p];
+        float sphere = plane.x * set.center_x[i] + plane.y * set.center_y[i] + plane.z * set.center_z[i] + plane.w;
+        float px = plane.x >= 0.0f ? set.max_x[i] : set.min_x[i];
+        float py = plane.y >= 0.0f ? set.max_y[i] : set.min_y[i];
+        float pz = plane.z >= 0.0f ? set.max_z[i] : set.min_z[i];
+        float box = plane.x * px + plane.y * py + plane.z * pz + plane.w;
+        if(sphere < -set.radius[i] || box < 0.0f) return false;
+    }
+    return true;
+}
+
+inline size_t cull_scalar(const Frustum &frustum, const CullSet &set, size_t first, size_t count, uint32_t* visible)
+{
+    size_t visible_count = 0;
+    for(size_t i = first; i < first + count; i++) {
+        if(cull_test_one(frustum, set, i)) {
+            visible[visible_count++] = (uint32_t)i;
+        }
+    }
+    return visible_count;
+}
+
+#if defined(__SSE2__)
+inline size_t cull_sse(const Frustum &frustum, const CullSet &set, size_t first, size_t count, uint32_t* visible)
+{
+    size_t visible_count = 0;
+    size_t end = first + count;
+    size_t i = first;
+    for(; i + 4 <= end; i += 4) {
+        __m128 cx = _mm_loadu_ps(&set.center_x[i]);
+        __m128 cy = _mm_loadu_ps(&set.center_y[i]);
+        __m128 cz = _mm_loadu_ps(&set.center_z[i]);
+        __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&set.radius[i]));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(int p = 0; p < 6; p++) {
+            const glm::vec4 &plane = frustum.planes[p];
+            __m128 nx = _mm_set1_ps(plane.x);
+            __m128 ny = _mm_set1_ps(plane.y);
+            __m128 nz = _mm_set1_ps(plane.z);
+            __m128 nw = _mm_set1_ps(plane.w);
+            __m128 sphere = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), nw));
+            //the corner is picked per plane, the same for all 4 objects
+            __m128 px = _mm_loadu_ps(plane.x >= 0.0f ? &set.max_x[i] : &set.min_x[i]);
+            __m128 py = _mm_loadu_ps(plane.y >= 0.0f ? &set.max_y[i] : &set.min_y[i]);
+            __m128 pz = _mm_loadu_ps(plane.z >= 0.0f ? &set.max_z[i] : &set.min_z[i]);
+            __m128 box = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, px), _mm_mul_ps(ny, py)), _mm_add_ps(_mm_mul_ps(nz, pz), nw));
+            inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(sphere, neg_r), _mm_cmpge_ps(box, _mm_setzero_ps())));
+        }
+        int mask = _mm_movemask_ps(inside);
+        while(mask) {
+            visible[visible_count++] = (uint32_t)(i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    return visible_count + cull_scalar(frustum, set, i, end - i, visible + visible_count);
+}
+#endif
+
+#if defined(__AVX__)
+inline size_t cull_avx(const Frustum &frustum, const CullSet &set, size_t first, size_t count, uint32_t* visible)
+{
+    size_t visible_count = 0;
+    size_t end = first + count;
+    size_t i = first;
+    for(; i + 8 <= end; i += 8) {
+        __m256 cx = _mm256_loadu_ps(&set.center_x[i]);
+        __m256 cy = _mm256_loadu_ps(&set.center_y[i]);
+        __m256 cz = _mm256_loadu_ps(&set.center_z[i]);
+        __m256 neg_r = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&set.radius[i]));
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(int p = 0; p < 6; p++) {
+            const glm::vec4 &plane = frustum.planes[p];
+            __m256 nx = _mm256_set1_ps(plane.x);
+            __m256 ny = _mm256_set1_ps(plane.y);
+            __m256 nz = _mm256_set1_ps(plane.z);
+            __m256 nw = _mm256_set1_ps(plane.w);
+            __m256 sphere = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)), _mm256_add_ps(_mm256_mul_ps(nz, cz), nw));
+            __m256 px = _mm256_loadu_ps(plane.x >= 0.0f ? &set.max_x[i] : &set.min_x[i]);
+            __m256 py = _mm256_loadu_ps(plane.y >= 0.0f ? &set.max_y[i] : &set.min_y[i]);
+            __m256 pz = _mm256_loadu_ps(plane.z >= 0.0f ? &set.max_z[i] : &set.min_z[i]);
+            __m256 box = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, px), _mm256_mul_ps(ny, py)), _mm256_add_ps(_mm256_mul_ps(nz, pz), nw));
+            inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(sphere, neg_r, _CMP_GE_OQ), _mm256_cmp_ps(box, _mm256_setzero_ps(), _CMP_GE_OQ)));
+        }
+        int mask = _mm256_movemask_ps(inside);
+        while(mask) {
+            visible[visible_count++] = (uint32_t)(i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    return visible_count + cull_scalar(frustum, set, i, end - i, visible + visible_count);
+}
+#endif
+
+//Widest kernel the build allows (AVX needs -mavx or -march=native)
+inline size_t cull(const Frustum &frustum, const CullSet &set, size_t first, size_t count, uint32_t* visible)
+{
+#if defined(__AVX__)
+    return cull_avx(frustum, set, first, count, visible);
+#elif defined(__SSE2__)
+    return cull_sse(frustum, set, first, count, visible);
+#else
+    return cull_scalar(frustum, set, first, count, visible);
+#endif
+}
@@ -0,0 +1,490 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include "stb/stb_dxt.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+//BC1/BC3 block encoder. The colors are encoded like stb_compress_dxt_block (stb_dxt.h): endpoints at the
+//pixels furthest apart along the principal axis of the block, indices by projecting on the endpoint line,
+//then one least squares refinement. The endpoint search (mean, covariance, extremes) has a scalar, an SSE
+//and an AVX kernel. Constant blocks and alpha still go through stb_dxt, and DXT_STB is stb_dxt for everything
+enum DxtEncoder { DXT_STB, DXT_SCALAR, DXT_SSE, DXT_AVX };
+const char* const dxt_encoder_names[4] = { "stb_dxt", "scalar", "sse", "avx" };
+
+//One 4x4 block: the pixels as floats one array per channel for the kernels, and as bytes for the rest
+struct DxtBlock
+{
+    alignas(32) float r[16];
+    alignas(32) float g[16];
+    alignas(32) float b[16];
+    unsigned char rgba[64];
+    unsigned char alpha[16];
+};
+
+//Block at pixel (x, y) of an image with 3 or 4 channels, the last row and column are repeated past the edges
+inline void dxt_load_block(const unsigned char* pixels, int width, int height, int channels, int x, int y, DxtBlock &block)
+{
+    for(int i = 0; i < 16; i++) {
+        int px = std::min(x + (i & 3), width - 1);
+        int py = std::min(y + (i >> 2), height - 1);
+        const unsigned char* p = pixels + ((size_t)py * width + px) * channels;
+        block.rgba[i * 4 + 0] = p[0];
+        block.rgba[i * 4 + 1] = p[1];
+        block.rgba[i * 4 + 2] = p[2];
+        block.rgba[i * 4 + 3] = channels == 4 ? p[3] : 255;
+        block.alpha[i] = block.rgba[i * 4 + 3];
+        block.r[i] = p[0];
+        block.g[i] = p[1];
+        block.b[i] = p[2];
+    }
+}
+
+//Principal axis from the covariance (r r, r g, r b, g g, g b, b b) by power iteration, starting from the
+//extent of the block. Luma when the colors barely spread
+inline void dxt_principal_axis(const float cov[6], const float extent[3], float axis[3])
+{
+    float x = extent[0], y = extent[1], z = extent[2];
+    for(int i = 0; i < 4; i++) {
+        float nx = x * cov[0] + y * cov[1] + z * cov[2];
+        float ny = x * cov[1] + y * cov[3] + z * cov[4];
+        float nz = x * cov[2] + y * cov[4] + z * cov[5];
+        x = nx;
+        y = ny;
+        z = nz;
+    }
+    float magnitude = std::max(fabsf(x), std::max(fabsf(y), fabsf(z)));
+    if(magnitude < 4.0f) {
+        axis[0] = 0.299f;
+        axis[1] = 0.587f;
+        axis[2] = 0.114f;
+        return;
+    }
+    axis[0] = x / magnitude;
+    axis[1] = y / magnitude;
+    axis[2] = z / magnitude;
+}
+
+//Each kernel writes the pixels with the smallest and the largest projection on the principal axis (the first one on ties)
+inline void dxt_endpoints_scalar(const DxtBlock &block, int &min_pixel, int &max_pixel)
+{
+    float sum[3] = { 0.0f, 0.0f, 0.0f };
+    float low[3] = { 255.0f, 255.0f, 255.0f };
+    float high[3] = { 0.0f, 0.0f, 0.0f };
+    const float* channels[3] = { block.r, block.g, block.b };
+    for(int c = 0; c < 3; c++) {
+        for(int i = 0; i < 16; i++) {
+            sum[c] += channels[c][i];
+            low[c] = std::min(low[c], channels[c][i]);
+            high[c] = std::max(high[c], channels[c][i]);
+        }
+    }
+    float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for(int i = 0; i < 16; i++) {
+        float r = block.r[i] - sum[0] / 16.0f;
+        float g = block.g[i] - sum[1] / 16.0f;
+        float b = block.b[i] - sum[2] / 16.0f;
+        cov[0] += r * r;
+        cov[1] += r * g;
+        cov[2] += r * b;
+        cov[3] += g * g;
+        cov[4] += g * b;
+        cov[5] += b * b;
+    }
+    float extent[3] = { high[0] - low[0], high[1] - low[1], high[2] - low[2] };
+    for(int i = 0; i < 6; i++) cov[i] /= 255.0f;
+    float axis[3];
+    dxt_principal_axis(cov, extent, axis);
+
+    float min_dot = 0.0f, max_dot = 0.0f;
+    for(int i = 0; i < 16; i++) {
+        float dot = block.r[i] * axis[0] + block.g[i] * axis[1] + block.b[i] * axis[2];
+        if(i == 0 || dot < min_dot) {
+            min_dot = dot;
+            min_pixel = i;
+        }
+        if(i == 0 || dot > max_dot) {
+            max_dot = dot;
+            max_pixel = i;
+        }
+    }
+}
+
+#if defined(__SSE2__)
+inline float dxt_hsum_sse(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+inline __m128 dxt_hmin_sse(__m128 v)
+{
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+inline __m128 dxt_hmax_sse(__m128 v)
+{
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+//4 pixels at a time
+inline void dxt_endpoints_sse(const DxtBlock &block, int &min_pixel, int &max_pixel)
+{
+    __m128 r[4], g[4], b[4];
+    for(int i = 0; i < 4; i++) {
+        r[i] = _mm_load_ps(block.r + 4 * i);
+        g[i] = _mm_load_ps(block.g + 4 * i);
+        b[i] = _mm_load_ps(block.b + 4 * i);
+    }
+    __m128 sum_r = _mm_add_ps(_mm_add_ps(r[0], r[1]), _mm_add_ps(r[2], r[3]));
+    __m128 sum_g = _mm_add_ps(_mm_add_ps(g[0], g[1]), _mm_add_ps(g[2], g[3]));
+    __m128 sum_b = _mm_add_ps(_mm_add_ps(b[0], b[1]), _mm_add_ps(b[2], b[3]));
+    __m128 low_r = _mm_min_ps(_mm_min_ps(r[0], r[1]), _mm_min_ps(r[2], r[3]));
+    __m128 low_g = _mm_min_ps(_mm_min_ps(g[0], g[1]), _mm_min_ps(g[2], g[3]));
+    __m128 low_b = _mm_min_ps(_mm_min_ps(b[0], b[1]), _mm_min_ps(b[2], b[3]));
+    __m128 high_r = _mm_max_ps(_mm_max_ps(r[0], r[1]), _mm_max_ps(r[2], r[3]));
+    __m128 high_g = _mm_max_ps(_mm_max_ps(g[0], g[1]), _mm_max_ps(g[2], g[3]));
+    __m128 high_b = _mm_max_ps(_mm_max_ps(b[0], b[1]), _mm_max_ps(b[2], b[3]));
+    __m128 mean_r = _mm_set1_ps(dxt_hsum_sse(sum_r) / 16.0f);
+    __m128 mean_g = _mm_set1_ps(dxt_hsum_sse(sum_g) / 16.0f);
+    __m128 mean_b = _mm_set1_ps(dxt_hsum_sse(sum_b) / 16.0f);
+
+    __m128 rr = _mm_setzero_ps(), rg = _mm_setzero_ps(), rb = _mm_setzero_ps();
+    __m128 gg = _mm_setzero_ps(), gb = _mm_setzero_ps(), bb = _mm_setzero_ps();
+    for(int i = 0; i < 4; i++) {
+        __m128 dr = _mm_sub_ps(r[i], mean_r);
+        __m128 dg = _mm_sub_ps(g[i], mean_g);
+        __m128 db = _mm_sub_ps(b[i], mean_b);
+        rr = _mm_add_ps(rr, _mm_mul_ps(dr, dr));
+        rg = _mm_add_ps(rg, _mm_mul_ps(dr, dg));
+        rb = _mm_add_ps(rb, _mm_mul_ps(dr, db));
+        gg = _mm_add_ps(gg, _mm_mul_ps(dg, dg));
+        gb = _mm_add_ps(gb, _mm_mul_ps(dg, db));
+        bb = _mm_add_ps(bb, _mm_mul_ps(db, db));
+    }
+    float cov[6] = { dxt_hsum_sse(rr) / 255.0f, dxt_hsum_sse(rg) / 255.0f, dxt_hsum_sse(rb) / 255.0f,
+        dxt_hsum_sse(gg) / 255.0f, dxt_hsum_sse(gb) / 255.0f, dxt_hsum_sse(bb) / 255.0f };
+    float extent[3] = { _mm_cvtss_f32(_mm_sub_ps(dxt_hmax_sse(high_r), dxt_hmin_sse(low_r))),
+        _mm_cvtss_f32(_mm_sub_ps(dxt_hmax_sse(high_g), dxt_hmin_sse(low_g))),
+        _mm_cvtss_f32(_mm_sub_ps(dxt_hmax_sse(high_b), dxt_hmin_sse(low_b))) };
+    float axis[3];
+    dxt_principal_axis(cov, extent, axis);
+
+    __m128 ar = _mm_set1_ps(axis[0]), ag = _mm_set1_ps(axis[1]), ab = _mm_set1_ps(axis[2]);
+    __m128 dots[4];
+    __m128 min_dot = _mm_set1_ps(INFINITY), max_dot = _mm_set1_ps(-INFINITY);
+    for(int i = 0; i < 4; i++) {
+        dots[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[i], ar), _mm_mul_ps(g[i], ag)), _mm_mul_ps(b[i], ab));
+        min_dot = _mm_min_ps(min_dot, dots[i]);
+        max_dot = _mm_max_ps(max_dot, dots[i]);
+    }
+    min_dot = dxt_hmin_sse(min_dot);
+    max_dot = dxt_hmax_sse(max_dot);
+    min_pixel = max_pixel = -1;
+    for(int i = 0; i < 4; i++) {
+        int min_mask = _mm_movemask_ps(_mm_cmpeq_ps(dots[i], min_dot));
+        int max_mask = _mm_movemask_ps(_mm_cmpeq_ps(dots[i], max_dot));
+        if(min_pixel < 0 && min_mask) min_pixel = 4 * i + __builtin_ctz(min_mask);
+        if(max_pixel < 0 && max_mask) max_pixel = 4 * i + __builtin_ctz(max_mask);
+    }
+}
+#endif
+
+#if defined(__AVX__)
+inline float dxt_hsum_avx(__m256 v)
+{
+    return dxt_hsum_sse(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+//8 pixels at a time
+inline void dxt_endpoints_avx(const DxtBlock &block, int &min_pixel, int &max_pixel)
+{
+    __m256 r[2], g[2], b[2];
+    for(int i = 0; i < 2; i++) {
+        r[i] = _mm256_load_ps(block.r + 8 * i);
+        g[i] = _mm256_load_ps(block.g + 8 * i);
+        b[i] = _mm256_load_ps(block.b + 8 * i);
+    }
+    __m256 low_r = _mm256_min_ps(r[0], r[1]), high_r = _mm256_max_ps(r[0], r[1]);
+    __m256 low_g = _mm256_min_ps(g[0], g[1]), high_g = _mm256_max_ps(g[0], g[1]);
+    __m256 low_b = _mm256_min_ps(b[0], b[1]), high_b = _mm256_max_ps(b[0], b[1]);
+    __m256 mean_r = _mm256_set1_ps(dxt_hsum_avx(_mm256_add_ps(r[0], r[1])) / 16.0f);
+    __m256 mean_g = _mm256_set1_ps(dxt_hsum_avx(_mm256_add_ps(g[0], g[1])) / 16.0f);
+    __m256 mean_b = _mm256_set1_ps(dxt_hsum_avx(_mm256_add_ps(b[0], b[1])) / 16.0f);
+
+    __m256 rr = _mm256_setzero_ps(), rg = _mm256_setzero_ps(), rb = _mm256_setzero_ps();
+    __m256 gg = _mm256_setzero_ps(), gb = _mm256_setzero_ps(), bb = _mm256_setzero_ps();
+    for(int i = 0; i < 2; i++) {
+        __m256 dr = _mm256_sub_ps(r[i], mean_r);
+        __m256 dg = _mm256_sub_ps(g[i], mean_g);
+        __m256 db = _mm256_sub_ps(b[i], mean_b);
+        rr = _mm256_add_ps(rr, _mm256_mul_ps(dr, dr));
+        rg = _mm256_add_ps(rg, _mm256_mul_ps(dr, dg));
+        rb = _mm256_add_ps(rb, _mm256_mul_ps(dr, db));
+        gg = _mm256_add_ps(gg, _mm256_mul_ps(dg, dg));
+        gb = _mm256_add_ps(gb, _mm256_mul_ps(dg, db));
+        bb = _mm256_add_ps(bb, _mm256_mul_ps(db, db));
+    }
+    float cov[6] = { dxt_hsum_avx(rr) / 255.0f, dxt_hsum_avx(rg) / 255.0f, dxt_hsum_avx(rb) / 255.0f,
+        dxt_hsum_avx(gg) / 255.0f, dxt_hsum_avx(gb) / 255.0f, dxt_hsum_avx(bb) / 255.0f };
+    __m128 low = dxt_hmin_sse(_mm_min_ps(_mm256_castps256_ps128(low_r), _mm256_extractf128_ps(low_r, 1)));
+    __m128 high = dxt_hmax_sse(_mm_max_ps(_mm256_castps256_ps128(high_r), _mm256_extractf128_ps(high_r, 1)));
+    float extent[3];
+    extent[0] = _mm_cvtss_f32(_mm_sub_ps(high, low));
+    low = dxt_hmin_sse(_mm_min_ps(_mm256_castps256_ps128(low_g), _mm256_extractf128_ps(low_g, 1)));
+    high = dxt_hmax_sse(_mm_max_ps(_mm256_castps256_ps128(high_g), _mm256_extractf128_ps(high_g, 1)));
+    extent[1] = _mm_cvtss_f32(_mm_sub_ps(high, low));
+    low = dxt_hmin_sse(_mm_min_ps(_mm256_castps256_ps128(low_b), _mm256_extractf128_ps(low_b, 1)));
+    high = dxt_hmax_sse(_mm_max_ps(_mm256_castps256_ps128(high_b), _mm256_extractf128_ps(high_b, 1)));
+    extent[2] = _mm_cvtss_f32(_mm_sub_ps(high, low));
+    float axis[3];
+    dxt_principal_axis(cov, extent, axis);
+
+    __m256 ar = _mm256_set1_ps(axis[0]), ag = _mm256_set1_ps(axis[1]), ab = _mm256_set1_ps(axis[2]);
+    __m256 dots[2];
+    for(int i = 0; i < 2; i++) {
+        dots[i] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r[i], ar), _mm256_mul_ps(g[i], ag)), _mm256_mul_ps(b[i], ab));
+    }
+    __m256 min8 = _mm256_min_ps(dots[0], dots[1]);
+    __m256 max8 = _mm256_max_ps(dots[0], dots[1]);
+    __m128 min4 = dxt_hmin_sse(_mm_min_ps(_mm256_castps256_ps128(min8), _mm256_extractf128_ps(min8, 1)));
+    __m128 max4 = dxt_hmax_sse(_mm_max_ps(_mm256_castps256_ps128(max8), _mm256_extractf128_ps(max8, 1)));
+    __m256 min_dot = _mm256_set_m128(min4, min4);
+    __m256 max_dot = _mm256_set_m128(max4, max4);
+    int min_mask = _mm256_movemask_ps(_mm256_cmp_ps(dots[0], min_dot, _CMP_EQ_OQ)) | _mm256_movemask_ps(_mm256_cmp_ps(dots[1], min_dot, _CMP_EQ_OQ)) << 8;
+    int max_mask = _mm256_movemask_ps(_mm256_cmp_ps(dots[0], max_dot, _CMP_EQ_OQ)) | _mm256_movemask_ps(_mm256_cmp_ps(dots[1], max_dot, _CMP_EQ_OQ)) << 8;
+    min_pixel = __builtin_ctz(min_mask);
+    max_pixel = __builtin_ctz(max_mask);
+}
+#endif
+
+//Widest kernel the build allows (AVX needs -mavx or -march=native)
+inline DxtEncoder dxt_widest_encoder()
+{
+#if defined(__AVX__)
+    return DXT_AVX;
+#elif defined(__SSE2__)
+    return DXT_SSE;
+#else
+    return DXT_SCALAR;
+#endif
+}
+
+//Whether this build has the kernel
+inline bool dxt_encoder_available(DxtEncoder encoder)
+{
+    return encoder <= dxt_widest_encoder();
+}
+
+inline int dxt_mul8(int a, int b)
+{
+    int t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+inline unsigned short dxt_pack565(int r, int g, int b)
+{
+    return (unsigned short)((dxt_mul8(r, 31) << 11) + (dxt_mul8(g, 63) << 5) + dxt_mul8(b, 31));
+}
+
+inline void dxt_unpack565(unsigned short v, unsigned char* out)
+{
+    out[0] = (((v >> 11) & 31) * 33) >> 2;
+    out[1] = (((v >> 5) & 63) * 65) >> 4;
+    out[2] = ((v & 31) * 33) >> 2;
+    out[3] = 255;
+}
+
+//x in [0, 1] to 5 or 6 bits (max 31 or 63), rounding against the midpoints of what the bits expand back to
+inline int dxt_quantize(float x, int max)
+{
+    x = std::min(std::max(x, 0.0f), 1.0f);
+    int q = (int)(x * max);
+    if(q < max) {
+        int shift = max == 31 ? 2 : 4;
+        int multiplier = max == 31 ? 33 : 65;
+        float midpoint = (((q * multiplier) >> shift) + (((q + 1) * multiplier) >> shift)) / 510.0f;
+        q += x > midpoint;
+    }
+    return q;
+}
+
+//The four colors of a 4 color block, c0 > c1
+inline void dxt_palette(unsigned short c0, unsigned short c1, unsigned char color[16])
+{
+    dxt_unpack565(c0, color);
+    dxt_unpack565(c1, color + 4);
+    for(int c = 0; c < 3; c++) {
+        color[8 + c] = (2 * color[c] + color[4 + c]) / 3;
+        color[12 + c] = (color[c] + 2 * color[4 + c]) / 3;
+    }
+    color[11] = color[15] = 255;
+}
+
+//2 bit index per pixel: the nearest palette color along the line between the endpoints
+inline unsigned int dxt_match_colors(const unsigned char* rgba, const unsigned char color[16])
+{
+    int dir_r = color[0] - color[4];
+    int dir_g = color[1] - color[5];
+    int dir_b = color[2] - color[6];
+    int stops[4];
+    for(int i = 0; i < 4; i++) {
+        stops[i] = color[i * 4] * dir_r + color[i * 4 + 1] * dir_g + color[i * 4 + 2] * dir_b;
+    }
+    int c0_point = stops[1] + stops[3];
+    int half_point = stops[3] + stops[2];
+    int c3_point = stops[2] + stops[0];
+    unsigned int mask = 0;
+    for(int i = 15; i >= 0; i--) {
+        int dot = 2 * (rgba[i * 4] * dir_r + rgba[i * 4 + 1] * dir_g + rgba[i * 4 + 2] * dir_b);
+        mask <<= 2;
+        if(dot < half_point) mask |= dot < c0_point ? 1 : 3;
+        else mask |= dot < c3_point ? 2 : 0;
+    }
+    return mask;
+}
+
+//Least squares endpoints for the indices in mask, false when they didn't change
+inline bool dxt_refine(const unsigned char* rgba, unsigned int mask, unsigned short &max16, unsigned short &min16)
+{
+    unsigned short old_max = max16, old_min = min16;
+    if((mask ^ (mask << 2)) < 4) { //every pixel has the same index, use the average color
+        int r = 8, g = 8, b = 8;
+        for(int i = 0; i < 16; i++) {
+            r += rgba[i * 4];
+            g += rgba[i * 4 + 1];
+            b += rgba[i * 4 + 2];
+        }
+        max16 = min16 = dxt_pack565(r >> 4, g >> 4, b >> 4);
+        return max16 != old_max || min16 != old_min;
+    }
+    static const int weights[4] = { 3, 0, 2, 1 };
+    int xx = 0, xy = 0, yy = 0;
+    int at1[3] = { 0, 0, 0 }, at2[3] = { 0, 0, 0 };
+    for(int i = 0; i < 16; i++, mask >>= 2) {
+        int w1 = weights[mask & 3];
+        int w2 = 3 - w1;
+        xx += w1 * w1;
+        yy += w2 * w2;
+        xy += w1 * w2;
+        for(int c = 0; c < 3; c++) {
+            at1[c] += w1 * rgba[i * 4 + c];
+            at2[c] += rgba[i * 4 + c];
+        }
+    }
+    for(int c = 0; c < 3; c++) at2[c] = 3 * at2[c] - at1[c];
+    float f = 3.0f / 255.0f / (xx * yy - xy * xy);
+    const int scale[3] = { 31, 63, 31 };
+    const int shift[3] = { 11, 5, 0 };
+    max16 = min16 = 0;
+    for(int c = 0; c < 3; c++) {
+        max16 |= dxt_quantize((at1[c] * yy - at2[c] * xy) * f, scale[c]) << shift[c];
+        min16 |= dxt_quantize((at2[c] * xx - at1[c] * xy) * f, scale[c]) << shift[c];
+    }
+    return max16 != old_max || min16 != old_min;
+}
+
+//8 byte BC1 color block
+inline void dxt_compress_color_block(unsigned char* dest, const DxtBlock &block, DxtEncoder encoder)
+{
+    const unsigned char* rgba = block.rgba;
+    bool constant = true;
+    for(int i = 1; i < 16 && constant; i++) {
+        constant = rgba[i * 4] == rgba[0] && rgba[i * 4 + 1] == rgba[1] && rgba[i * 4 + 2] == rgba[2];
+    }
+    if(constant) { //stb_dxt has the exact endpoints for a single color
+        unsigned char opaque[64];
+        for(int i = 0; i < 16; i++) {
+            memcpy(opaque + i * 4, rgba, 3);
+            opaque[i * 4 + 3] = 255;
+        }
+        stb_compress_dxt_block(dest, opaque, 0, STB_DXT_NORMAL);
+        return;
+    }
+
+    int min_pixel = 0, max_pixel = 0;
+    switch(encoder) {
+#if defined(__AVX__)
+        case DXT_AVX: dxt_endpoints_avx(block, min_pixel, max_pixel); break;
+#endif
+#if defined(__SSE2__)
+        case DXT_SSE: dxt_endpoints_sse(block, min_pixel, max_pixel); break;
+#endif
+        default: dxt_endpoints_scalar(block, min_pixel, max_pixel); break;
+    }
+    unsigned short max16 = dxt_pack565(rgba[max_pixel * 4], rgba[max_pixel * 4 + 1], rgba[max_pixel * 4 + 2]);
+    unsigned short min16 = dxt_pack565(rgba[min_pixel * 4], rgba[min_pixel * 4 + 1], rgba[min_pixel * 4 + 2]);
+    unsigned char color[16];
+    unsigned int mask = 0;
+    if(max16 != min16) {
+        dxt_palette(max16, min16, color);
+        mask = dxt_match_colors(rgba, color);
+    }
+    if(dxt_refine(rgba, mask, max16, min16)) {
+        mask = 0;
+        if(max16 != min16) {
+            dxt_palette(max16, min16, color);
+            mask = dxt_match_colors(rgba, color);
+        }
+    }
+
+    //4 color mode needs c0 > c1
+    if(max16 < min16) {
+        std::swap(max16, min16);
+        mask ^= 0x55555555;
+    }
+    dest[0] = (unsigned char)max16;
+    dest[1] = (unsigned char)(max16 >> 8);
+    dest[2] = (unsigned char)min16;
+    dest[3] = (unsigned char)(min16 >> 8);
+    dest[4] = (unsigned char)mask;
+    dest[5] = (unsigned char)(mask >> 8);
+    dest[6] = (unsigned char)(mask >> 16);
+    dest[7] = (unsigned char)(mask >> 24);
+}
+
+//BC1 (8 bytes) without alpha, BC3 (16 bytes: the alpha as a BC4 block, then the colors) with
+inline void dxt_compress_block(unsigned char* dest, const DxtBlock &block, bool alpha, DxtEncoder encoder)
+{
+    if(encoder == DXT_STB) {
+        stb_compress_dxt_block(dest, block.rgba, alpha, STB_DXT_NORMAL);
+        return;
+    }
+    if(alpha) {
+        stb_compress_bc4_block(dest, block.alpha);
+        dest += 8;
+    }
+    dxt_compress_color_block(dest, block, encoder);
+}
+
+//Back to 16 RGBA pixels from a BC1 color block (alpha 255), to measure the error
+inline void dxt_decompress_color_block(const unsigned char* src, unsigned char rgba[64])
+{
+    unsigned short c0 = src[0] | src[1] << 8;
+    unsigned short c1 = src[2] | src[3] << 8;
+    unsigned char color[16];
+    dxt_palette(c0, c1, color);
+    if(c0 <= c1) { //3 color mode: the middle color and black
+        for(int c = 0; c < 3; c++) {
+            color[8 + c] = (color[c] + color[4 + c]) / 2;
+            color[12 + c] = 0;
+        }
+    }
+    unsigned int mask = src[4] | src[5] << 8 | src[6] << 16 | (unsigned int)src[7] << 24;
+    for(int i = 0; i < 16; i++, mask >>= 2) {
+        memcpy(rgba + i * 4, color + (mask & 3) * 4, 4);
+    }
+}
@@ -0,0 +1,134 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include "glm/glm.hpp"
+#include "mesh_pool.h"
+#include "obj_loader.h"
+#include "mesh_optimize.h"
+#include "arena.h"
+
+//Pip geometry, generated instead of read from an OBJ. Level 0 is the icosahedron (20 triangles),
+//every subdivision splits each triangle in 4 and pushes the new vertices out to the unit sphere
+const int ICOSPHERE_MAX_SUBDIVISIONS = 6;
+const int ICOSPHERE_DEFAULT_SUBDIVISIONS = 3;
+
+//Splits every triangle in 4. Edge midpoints are shared by both triangles of the edge and appended after
+//the existing vertices, so the vertices of a coarser level are always the first ones of a finer level
+inline std::vector<unsigned int> subdivide_icosphere(const std::vector<unsigned int> &indices, std::pmr::vector<glm::vec3> &positions)
+{
+    std::unordered_map<uint64_t, unsigned int> midpoints;
+    std::vector<unsigned int> result;
+    result.reserve(indices.size() * 4);
+    for(size_t t = 0; t < indices.size(); t += 3) {
+        unsigned int middle[3];
+        for(int e = 0; e < 3; e++) {
+            unsigned int a = indices[t + e];
+            unsigned int b = indices[t + (e + 1) % 3];
+            uint64_t key = (uint64_t)std::min(a, b) << 32 | std::max(a, b);
+            std::unordered_map<uint64_t, unsigned int>::iterator found = midpoints.find(key);
+            if(found == midpoints.end()) {
+                found = midpoints.insert(std::make_pair(key, (unsigned int)positions.size())).first;
+                positions.push_back(glm::normalize(positions[a] + positions[b]));
+            }
+            middle[e] = found->second;
+        }
+        unsigned int split[12] = {
+            indices[t], middle[0], middle[2],
+            middle[0], indices[t + 1], middle[1],
+            middle[2], middle[1], indices[t + 2],
+            middle[0], middle[1], middle[2]
+        };
+        result.insert(result.end(), split, split + 12);
+    }
+    return result;
+}
+
+//Largest distance between the flat triangles and the sphere, at the middle of the triangle
+inline float icosphere_error(const std::vector<unsigned int> &indices, const std::pmr::vector<glm::vec3> &positions)
+{
+    float error = 0.0f;
+    for(size_t t = 0; t < indices.size(); t += 3) {
+        const glm::vec3 &a = positions[indices[t]];
+        glm::vec3 normal = glm::normalize(glm::cross(positions[indices[t + 1]] - a, positions[indices[t + 2]] - a));
+        error = std::max(error, 1.0f - glm::dot(normal, a));
+    }
+    return error;
+}
+
+//Unit icosphere with shared vertices (the normal of a vertex is its position). The coarser subdivision levels
+//become its LOD chain: they only use the first vertices, so each one is just another index range appended to model.indices.
+//Every level is optimized for the vertex cache. model has to be empty, its arrays are sized once
+inline void generate_icosphere(int subdivisions, ObjModel &model, std::vector<MeshLod> &lods)
+{
+    const float t = (1.0f + sqrtf(5.0f)) / 2.0f;
+    const glm::vec3 corners[12] = {
+        glm::vec3(-1, t, 0), glm::vec3(1, t, 0), glm::vec3(-1, -t, 0), glm::vec3(1, -t, 0),
+        glm::vec3(0, -1, t), glm::vec3(0, 1, t), glm::vec3(0, -1, -t), glm::vec3(0, 1, -t),
+        glm::vec3(t, 0, -1), glm::vec3(t, 0, 1), glm::vec3(-t, 0, -1), glm::vec3(-t, 0, 1)
+    };
+    const unsigned int faces[60] = {
+        0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+        1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+        3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+        4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1
+    };
+    size_t index_total = 0;
+    for(int s = subdivisions; s >= 0 && s > subdivisions - MAX_LODS; s--) {
+        index_total += 60 << (2 * s);
+    }
+    model.positions.reserve(10 * (1 << (2 * subdivisions)) + 2);
+    model.indices.reserve(index_total);
+    for(int i = 0; i < 12; i++) {
+        model.positions.push_back(glm::normalize(corners[i]));
+    }
+
+    std::vector<std::vector<unsigned int> > levels(1, std::vector<unsigned int>(faces, faces + 60));
+    for(int s = 0; s < subdivisions; s++) {
+        levels.push_back(subdivide_icosphere(levels.back(), model.positions));
+    }
+    model.normals = model.positions;
+
+    //finest first, as many coarser levels as fit
+    lods.clear();
+    for(int s = subdivisions; s >= 0 && (int)lods.size() < MAX_LODS; s--) {
+        std::vector<unsigned int> &level = levels[s];
+        optimize_vertex_cache(&level[0], level.size(), model.positions.size());
+        MeshLod lod = { (GLuint)model.indices.size(), (GLuint)level.size(), s == subdivisions ? 0.0f : icosphere_error(level, model.positions) };
+        model.indices.insert(model.indices.end(), level.begin(), level.end());
+        lods.push_back(lod);
+    }
+}
+
+//Icospheres added to a mesh pool, each tessellation level is generated and added only once
+class IcosphereCache
+{
+    public:
+    const MeshRange& get(MeshPool &pool, int subdivisions)
+    {
+        std::map<int, MeshRange>::iterator found = ranges.find(subdivisions);
+        if(found != ranges.end()) {
+            return found->second;
+        }
+        LoadArena arena;
+        ObjModel model(arena.resource());
+        std::vector<MeshLod> lods;
+        generate_icosphere(subdivisions, model, lods);
+        std::pmr::vector<unsigned char> packed(arena.resource());
+        glm::vec3 bounds_min, bounds_max;
+        pool.pack_vertices(model.positions, model.normals, model.texcoords, packed, bounds_min, bounds_max);
+        MeshRange range = pool.add_packed_mesh(&packed[0], model.positions.size(), &model.indices[0], model.indices.size(), bounds_min, bounds_max,
+            &lods[0], lods.size());
+        return ranges[subdivisions] = range;
+    }
+
+    private:
+    std::map<int, MeshRange> ranges;
+};
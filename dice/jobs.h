@@ -0,0 +1,118 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+//Fixed pool of worker threads for data parallel loops. run() hands out indices [0, count) one at a time,
+//the calling thread works too, and it returns once every index is done. Jobs must not touch GL.
+class JobSystem
+{
+    public:
+    ~JobSystem() { stop(); } //early returns in main would otherwise leave joinable threads behind
+
+    //threads counts the calling thread, 1 means everything runs inline
+    void start(int threads)
+    {
+        for(int i = 1; i < threads; i++) {
+            workers.push_back(std::thread(&JobSystem::worker_loop, this));
+        }
+    }
+
+    int thread_count() const { return (int)workers.size() + 1; }
+
+    void run(int count, const std::function<void(int)> &job)
+    {
+        dispatch(count, job);
+        work();
+        wait();
+    }
+
+    //Like run() but only the workers take indices and it returns right away, so the calling thread can
+    //do something else (e.g. GL uploads) meanwhile. job must outlive the wait() that has to follow.
+    //Without workers it all runs inline before returning
+    void run_async(int count, const std::function<void(int)> &job)
+    {
+        if(workers.empty()) {
+            run(count, job);
+            return;
+        }
+        dispatch(count, job);
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending == 0; });
+        current_job = NULL;
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for(size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+        workers.clear();
+    }
+
+    private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(int)>* current_job = NULL;
+    int job_count = 0;
+    std::atomic<int> next_index{0};
+    int pending = 0;
+    long generation = 0;
+    bool quit = false;
+
+    void dispatch(int count, const std::function<void(int)> &job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current_job = &job;
+            job_count = count;
+            next_index = 0;
+            pending = (int)workers.size();
+            generation++;
+        }
+        wake.notify_all();
+    }
+
+    void work()
+    {
+        for(int i = next_index.fetch_add(1); i < job_count; i = next_index.fetch_add(1)) {
+            (*current_job)(i);
+        }
+    }
+
+    void worker_loop()
+    {
+        long seen = 0;
+        while(true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seen] { return quit || generation != seen; });
+                if(quit) return;
+                seen = generation;
+            }
+            work();
+            std::lock_guard<std::mutex> lock(mutex);
+            if(--pending == 0) done.notify_one();
+        }
+    }
+};
@@ -1,14 +1,34 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#ifdef DICE_WITH_ASSIMP //only for --obj-bench, meshes are read by obj_loader.h
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
+#endif
 
 #include "aux.h"
+#include "shader.h"
+#include "scene.h"
+#include "mesh_pool.h"
+#include "oit.h"
+#include "cull.h"
+#include "render_queue.h"
+#include "command_list.h"
+#include "jobs.h"
+#include "obj_loader.h"
+#include "mesh_cache.h"
+#include "icosphere.h"
+#include "startup.h"
+#include "texture_cache.h"
+#include "dxt.h"
+#include "cubemap.h"
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtx/transform.hpp"
@@ -16,58 +36,78 @@
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STB_DXT_IMPLEMENTATION
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
 
 #include "stb/stb_image.h"
 #include "stb/stb_image_resize.h"
 #include "stb/stb_image_write.h"
+#include "stb/stb_dxt.h"
+
+//Shared by the blended and the OIT die shaders
+#define DIE_GLASS_GLSL \
+"in vec3 fragmentNormals;" \
+"in vec3 texcoords;" \
+"in mat4 total_matrix;" \
+"" \
+"uniform samplerCube sampler;" \
+SRGB_ENCODE_GLSL \
+"" \
+"vec4 glass_color() {" \
+"	float ratio = 1.00 / 1.52;" \
+"	vec3 refraction = refract(normalize(texcoords), normalize(fragmentNormals), ratio);" \
+"" \
+"	vec3 refraction_dir = (total_matrix * vec4(refraction, 0.0)).xyw;" \
+"	vec4 glass = texture(sampler, refraction_dir);" \
+"	glass.rgb = srgb_encode(glass.rgb);" \
+"	glass.a = 0.9;" \
+"	return glass;" \
+"}"
 
 const char* die_fragment_shader =
 "#version 330 core\n"
-""
-"in vec3 fragmentNormals;"
-"in vec3 texcoords;"
-"in mat4 total_matrix;"
-""
-"uniform samplerCube sampler;"
+DIE_GLASS_GLSL
 ""
 "out vec4 glass;"
 ""
 "void main() {"
-"	float ratio = 1.00 / 1.52;"
-"	vec3 refraction = refract(normalize(texcoords), normalize(fragmentNormals), ratio);"
+"	glass = glass_color();"
+"}";
+
+const char* die_oit_fragment_shader =
+"#version 330 core\n"
+DIE_GLASS_GLSL
+OIT_OUTPUT_GLSL
 ""
-"	vec3 refraction_dir = (total_matrix * vec4(refraction, 0.0)).xyw;"
-"	glass = texture(sampler, refraction_dir);"
-"	glass.a = 0.9;"
+"void main() {"
+"	write_oit(glass_color());"
 "}";
 
 const char* die_vertex_shader =
 "#version 330 core\n"
 "layout(location = 0) in vec3 vertices;"
 "layout(location = 1) in vec3 normals;"
-"layout(location = 4) in vec3 indices;"
+"layout(location = 3) in mat4 model_matrix;" //per instance, takes locations 3 to 6
+DEQUANTIZE_GLSL
 ""
-"uniform mat4 die_matrix;"
-"uniform mat4 model_matrix;"
-"uniform vec3 camera_position;"
+CAMERA_BLOCK_GLSL
 ""
 "out vec3 fragmentNormals;"
 "out vec3 texcoords;"
 "out mat4 total_matrix;"
 ""
 "void main() {"
+"	vec3 position = dequant_offset.xyz + vertices * dequant_scale.xyz;"
 "	fragmentNormals = vec3(vec4(normals, 0.0) * model_matrix);"
-"	texcoords = vec3(model_matrix * vec4(vertices, 1.0) - vec4(camera_position, 1.0));"
-"	total_matrix = die_matrix * model_matrix;"
+"	texcoords = vec3(model_matrix * vec4(position, 1.0) - vec4(camera_position.xyz, 1.0));"
+"	total_matrix = projection_matrix * view_matrix * model_matrix;"
 ""
-"   gl_Position = total_matrix * vec4(vertices, 1.0);"
+"   gl_Position = total_matrix * vec4(position, 1.0);"
 "}";
 
 const char* sphere_fragment_shader = 
 "#version 330 core\n"
 ""
-"in vec3 texcoords;"
-""
 "void main()"
 "{"
 "	gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);"
@@ -76,35 +116,49 @@ const char* sphere_fragment_shader =
 const char* sphere_vertex_shader = 
 "#version 330 core\n"
 "layout(location = 0) in vec3 vertices;"
-"layout(location = 1) in vec3 colors;"
-"layout(location = 2) in vec3 indices;"
+"layout(location = 3) in mat4 model_matrix;" //per instance, takes locations 3 to 6
+DEQUANTIZE_GLSL
+""
+CAMERA_BLOCK_GLSL
+""
+"void main()" 
+"{"
+	"mat4 total_matrix = projection_matrix * view_matrix * model_matrix;"
+	"vec3 position = dequant_offset.xyz + vertices * dequant_scale.xyz;"
+	""
+	"gl_Position = total_matrix * vec4(position, 1.0);"
+"}";
+
+//The old one-draw-per-pip shader, only kept so --pip-bench can compare against it
+const char* sphere_uniform_vertex_shader = 
+"#version 330 core\n"
+"layout(location = 0) in vec3 vertices;"
+DEQUANTIZE_GLSL
 ""
 "uniform mat4 sphere_matrix;"
 "uniform mat4 model_matrix;"
 ""
-"out vec3 texcoords;"
-""
 "void main()" 
 "{"
-	"texcoords = colors;"
-	"mat4 total_matrix = sphere_matrix * model_matrix;"
-	""
-	"gl_Position = total_matrix * vec4(vertices, 1.0);"
+	"vec3 position = dequant_offset.xyz + vertices * dequant_scale.xyz;"
+	"gl_Position = sphere_matrix * model_matrix * vec4(position, 1.0);"
 "}";
 
 const char* skybox_vertex_shader =
 "#version 330 core\n"
 "layout(location = 0) in vec3 vertices;"
+"layout(location = 3) in mat4 model_matrix;" //per instance, takes locations 3 to 6
+DEQUANTIZE_GLSL
 ""
-"uniform mat4 skybox_matrix;"
-"uniform mat4 model_matrix;"
+CAMERA_BLOCK_GLSL
 ""
 "out vec3 texcoords;"
 ""
 "void main()"
 "{"
-"	texcoords = vertices;"
-"	gl_Position = skybox_matrix * model_matrix * vec4(vertices, 1.0);"
+"	vec3 position = dequant_offset.xyz + vertices * dequant_scale.xyz;"
+"	texcoords = position;"
+"	gl_Position = projection_matrix * skybox_view_matrix * model_matrix * vec4(position, 1.0);"
 "}";
 
 const char* skybox_fragment_shader =
@@ -113,10 +167,12 @@ const char* skybox_fragment_shader =
 "in vec3 texcoords;"
 ""
 "uniform samplerCube sampler;"
+SRGB_ENCODE_GLSL
 ""
 "void main()"
 "{"
-"	gl_FragColor = texture(sampler, texcoords);"
+"	vec4 sky = texture(sampler, texcoords);"
+"	gl_FragColor = vec4(srgb_encode(sky.rgb), sky.a);"
 "}";
 
 typedef struct projection
@@ -134,6 +190,24 @@ typedef struct view
 	glm::vec3 axis;
 }VIEW;
 
+const int PIPS_PER_DIE = 21;
+const int MAX_DICE = 100000;
+
+//Where the two dice of the default scene sit and how much they are tilted around Z, in degrees
+const glm::vec3 die_positions[2] = { glm::vec3(-0.8f, 0.0f, 0.0f), glm::vec3(0.8f, 0.0f, 0.0f) };
+const float die_tilts[2] = { -15.0f, 14.3f };
+
+//Pip positions in die space, before the 0.1 pip scale. Grouped by face (1, 2, 3, 4, 5, 6)
+const glm::vec3 pip_offsets[PIPS_PER_DIE] = {
+	glm::vec3(0.0f, 0.0f, 6.0f),
+	glm::vec3(6.0f, 3.0f, -3.0f), glm::vec3(6.0f, -3.0f, 3.0f),
+	glm::vec3(3.0f, 6.0f, -3.0f), glm::vec3(0.0f, 6.0f, 0.0f), glm::vec3(-3.0f, 6.0f, 3.0f),
+	glm::vec3(-3.0f, -6.0f, 3.0f), glm::vec3(3.0f, -6.0f, -3.0f), glm::vec3(-3.0f, -6.0f, -3.0f), glm::vec3(3.0f, -6.0f, 3.0f),
+	glm::vec3(-6.0f, -3.0f, 3.0f), glm::vec3(-6.0f, -3.0f, -3.0f), glm::vec3(-6.0f, 3.0f, 3.0f), glm::vec3(-6.0f, 3.0f, -3.0f), glm::vec3(-6.0f, 0.0f, 0.0f),
+	glm::vec3(-3.0f, -3.0f, -6.0f), glm::vec3(-3.0f, 0.0f, -6.0f), glm::vec3(-3.0f, 3.0f, -6.0f), glm::vec3(3.0f, -3.0f, -6.0f), glm::vec3(3.0f, 0.0f, -6.0f), glm::vec3(3.0f, 3.0f, -6.0f)
+};
+
+#ifdef DICE_WITH_ASSIMP
 int load_obj_file(const std::string &file, std::vector <glm::vec3> &Vertices, std::vector <glm::vec3> &Normals, std::vector <glm::vec3> &Texcoords, std::vector<glm::vec3> &Tangents, std::vector<unsigned int> &Indices) {
 	Assimp::Importer importer;
 	const aiScene* scene = importer.ReadFile(file, aiProcess_Triangulate);
@@ -143,6 +217,11 @@ int load_obj_file(const std::string &file, std::vector <glm::vec3> &Vertices, st
 	}
 	
 	const aiMesh* mesh = scene->mMeshes[0];
+	Vertices.reserve(Vertices.size() + mesh->mNumVertices);
+	if(mesh->HasNormals()) Normals.reserve(Normals.size() + mesh->mNumVertices);
+	if(mesh->HasTextureCoords(0)) Texcoords.reserve(Texcoords.size() + mesh->mNumVertices);
+	if(mesh->HasTangentsAndBitangents()) Tangents.reserve(Tangents.size() + mesh->mNumVertices);
+	Indices.reserve(Indices.size() + mesh->mNumFaces * 3);
 	
 	for(int i = 0; i < mesh->mNumVertices; i++) {
 		const aiVector3D& mesh_vert = mesh->mVertices[i];
@@ -170,6 +249,7 @@ int load_obj_file(const std::string &file, std::vector <glm::vec3> &Vertices, st
 	
 	return mesh->mNumVertices;
 }
+#endif
 
 void captureScene(int screenshot_number, int win_width, int win_height) {
 	GLubyte* pixels = new GLubyte[3 * win_width * win_height];
@@ -192,115 +272,600 @@ void captureScene(int screenshot_number, int win_width, int win_height) {
 	std::cout << "Screenshot taken!\n";
 }
 
-GLuint load_cube_tex(const char* dir, int channels) {
-	int width;
-	int height;
-	int comp;
-	char* img;
-	unsigned char* tex_data;
-	GLuint texture;
-	
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
-	img = (char*)"right.jpg"; 
-	char* right = (char*)malloc((strlen(dir) + strlen(img) + 1) *  sizeof(char));
-	strcpy(right, dir);
-	strcat(right, img);
-	tex_data = stbi_load(right, &width, &height, &comp, channels);
-	if(!tex_data) {
-		std::cerr << "Failed to load right texture.\n";
-		stbi_image_free(tex_data);
-		return -1;
+const double IDLE_WAIT_TIMEOUT = 0.5; //seconds, upper bound on how long an idle frame loop sleeps
+const double STATS_INTERVAL = 2.0;
+
+bool window_damaged = false;
+
+//Expose/damage events, the window contents have to be drawn again even though nothing changed
+void window_refresh_callback(GLFWwindow*) {
+	window_damaged = true;
+}
+
+//--layout for --dice N. PAIR is the original two dice scene
+enum DiceLayout
+{
+	LAYOUT_PAIR,
+	LAYOUT_GRID,
+	LAYOUT_RANDOM
+};
+
+//Local matrices of every die. Grid and random layouts are shrunk so the whole set stays about as wide as the pair
+std::vector<glm::mat4> make_dice_layout(int count, int layout) {
+	std::vector<glm::mat4> dice(count);
+	if(layout == LAYOUT_PAIR) {
+		for(int i = 0; i < count; i++) {
+			dice[i] = glm::translate(aux::mat4_identity, die_positions[i]);
+			dice[i] = glm::rotate(dice[i], aux::degrees_to_radians(die_tilts[i]), glm::vec3(0.0f, 0.0f, 1.0f));
+		}
+		return dice;
 	}
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, tex_data);
-	stbi_image_free(tex_data);
-	free(right);
-	
-	img = (char*)"left.jpg"; 
-	char* left = (char*)malloc((strlen(dir) + strlen(img) + 1) *  sizeof(char));
-	strcpy(left, dir);
-	strcat(left, img);
-	tex_data = stbi_load(left, &width, &height, &comp, channels);
-	if(!tex_data) {
-		std::cerr << "Failed to load left texture.\n";
-		stbi_image_free(tex_data);
-		return -1;
+	const float spacing = 1.6f;
+	if(layout == LAYOUT_GRID) {
+		int columns = (int)ceil(sqrt((float)count));
+		int rows = (count + columns - 1) / columns;
+		float scale = std::min(1.0f, 2.0f / columns);
+		for(int i = 0; i < count; i++) {
+			glm::vec3 position(((i % columns) - (columns - 1) * 0.5f) * spacing, ((rows - 1) * 0.5f - i / columns) * spacing, 0.0f);
+			dice[i] = glm::scale(aux::mat4_identity, glm::vec3(scale));
+			dice[i] = glm::translate(dice[i], position);
+			dice[i] = glm::rotate(dice[i], aux::degrees_to_radians(die_tilts[i % 2]), glm::vec3(0.0f, 0.0f, 1.0f));
+		}
+		return dice;
 	}
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, tex_data);
-	stbi_image_free(tex_data);
-	free(left);
-
-	img = (char*)"top.jpg"; 
-	char* top = (char*)malloc((strlen(dir) + strlen(img) + 1) *  sizeof(char));
-	strcpy(top, dir);
-	strcat(top, img);
-	tex_data = stbi_load(top, &width, &height, &comp, channels);
-	if(!tex_data) {
-		std::cerr << "Failed to load top texture.\n";
-		stbi_image_free(tex_data);
-		return -1;
+	//random: same density as the grid but spread through a cube, fixed seed so runs are comparable
+	srand(1);
+	float extent = spacing * (float)ceil(cbrt((float)count));
+	float scale = std::min(1.0f, 3.2f / extent);
+	for(int i = 0; i < count; i++) {
+		glm::vec3 position(rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f);
+		glm::vec3 axis(rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX + 0.01f);
+		dice[i] = glm::scale(aux::mat4_identity, glm::vec3(scale));
+		dice[i] = glm::translate(dice[i], position * extent);
+		dice[i] = glm::rotate(dice[i], rand() / (float)RAND_MAX * 6.2832f, glm::normalize(axis));
 	}
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, tex_data);
-	stbi_image_free(tex_data);
-	free(top);
-	
-	img = (char*)"bottom.jpg"; 
-	char* bottom = (char*)malloc((strlen(dir) + strlen(img) + 1) *  sizeof(char));
-	strcpy(bottom, dir);
-	strcat(bottom, img);
-	tex_data = stbi_load(bottom, &width, &height, &comp, channels);
-	if(!tex_data) {
-		std::cerr << "Failed to load bottom texture.\n";
-		stbi_image_free(tex_data);
-		return -1;
+	return dice;
+}
+
+//How the glass dice are blended, T cycles through them
+enum TransparencyMode
+{
+	TRANSPARENCY_BLEND,  //the original path, dice in a fixed order and back faces in whatever order they come
+	TRANSPARENCY_SORTED, //reference: dice sorted back to front every frame, back faces before front faces
+	TRANSPARENCY_OIT     //weighted blended OIT, no sorting
+};
+const char* transparency_names[3] = { "blend", "sorted", "oit" };
+
+//Keys that animate for as long as they are held down
+bool continuous_key_held(GLFWwindow* window) {
+	const int keys[6] = {GLFW_KEY_LEFT, GLFW_KEY_RIGHT, GLFW_KEY_UP, GLFW_KEY_DOWN, GLFW_KEY_LEFT_CONTROL, GLFW_KEY_LEFT_SHIFT};
+	for(int i = 0; i < 6; i++) {
+		if(glfwGetKey(window, keys[i]) == GLFW_PRESS) return true;
 	}
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, tex_data);
-	stbi_image_free(tex_data);
-	free(bottom);
-	
-	img = (char*)"front.jpg"; 
-	char* front = (char*)malloc((strlen(dir) + strlen(img) + 1) *  sizeof(char));
-	strcpy(front, dir);
-	strcat(front, img);
-	tex_data = stbi_load(front, &width, &height, &comp, channels);
-	if(!tex_data) {
-		std::cerr << "Failed to load front texture.\n";
-		stbi_image_free(tex_data);
-		return -1;
+	return false;
+}
+
+//Frames rendered and process CPU usage, printed every STATS_INTERVAL seconds with --stats, along with
+//the per frame averages of draw calls, triangles, render queue state changes (issued and filtered out), CPU time spent building the frame, GPU time (GL_TIME_ELAPSED)
+//and triangles drawn at each LOD.
+//GPU queries are read a few frames late so they never stall the pipeline
+const int GPU_QUERY_FRAMES = 4;
+
+struct FrameStats
+{
+	long frames_rendered = 0;
+	long last_frames = 0;
+	double last_time = 0.0;
+	clock_t last_cpu = 0;
+
+	long draw_calls = 0;
+	long triangles = 0;
+	long state_changes = 0;
+	long state_changes_avoided = 0;
+	long lod_triangles[MAX_LODS] = {};
+	long ring_stalls = 0; //total times the CPU had to wait for the GPU to release a ring slice
+	double cpu_ms = 0.0;
+	double gpu_ms = 0.0;
+	long gpu_samples = 0;
+	double frame_start = 0.0;
+	GLuint queries[GPU_QUERY_FRAMES] = {};
+	bool query_pending[GPU_QUERY_FRAMES] = {};
+	bool gpu_timer = false;
+
+	void start(double now) {
+		last_time = now;
+		last_cpu = clock();
+		gpu_timer = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+		if(gpu_timer) glGenQueries(GPU_QUERY_FRAMES, queries);
 	}
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, tex_data);
-	stbi_image_free(tex_data);
-	free(front);
-	
-	img = (char*)"back.jpg"; 
-	char* back = (char*)malloc((strlen(dir) + strlen(img) + 1) *  sizeof(char));
-	strcpy(back, dir);
-	strcat(back, img);
-	tex_data = stbi_load(back, &width, &height, &comp, channels);
-	if(!tex_data) {
-		std::cerr << "Failed to load back texture.\n";
-		stbi_image_free(tex_data);
-		return -1;
+
+	void begin_frame(double now) {
+		frame_start = now;
+		if(!gpu_timer) return;
+		int q = frames_rendered % GPU_QUERY_FRAMES;
+		if(query_pending[q]) { //GPU_QUERY_FRAMES old, almost always done already
+			GLuint64 elapsed;
+			glGetQueryObjectui64v(queries[q], GL_QUERY_RESULT, &elapsed);
+			gpu_ms += elapsed / 1000000.0;
+			gpu_samples++;
+		}
+		glBeginQuery(GL_TIME_ELAPSED, queries[q]);
+		query_pending[q] = true;
 	}
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, tex_data);
-	stbi_image_free(tex_data);
-	free(back);
-	
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
-	return texture;
+	//before the swap, so waiting for vsync doesn't count as CPU time
+	void end_frame(double now, long frame_draw_calls, long frame_triangles, long frame_state_changes, long frame_state_changes_avoided, const long frame_lod_triangles[MAX_LODS]) {
+		if(gpu_timer) glEndQuery(GL_TIME_ELAPSED);
+		cpu_ms += (now - frame_start) * 1000.0;
+		draw_calls += frame_draw_calls;
+		triangles += frame_triangles;
+		state_changes += frame_state_changes;
+		state_changes_avoided += frame_state_changes_avoided;
+		for(int l = 0; l < MAX_LODS; l++) lod_triangles[l] += frame_lod_triangles[l];
+		frames_rendered++;
+	}
+
+	void report(double now) {
+		if(now - last_time < STATS_INTERVAL) return;
+		clock_t cpu = clock();
+		double cpu_percent = 100.0 * (double(cpu - last_cpu) / CLOCKS_PER_SEC) / (now - last_time);
+		long frames = frames_rendered - last_frames;
+		std::cout << "frames rendered: " << frames_rendered << " (" << frames << " in " << now - last_time << "s), cpu: " << cpu_percent << "%";
+		if(frames > 0) {
+			std::cout << ", per frame: " << draw_calls / frames << " draws, " << triangles / frames << " triangles, "
+				<< state_changes / frames << " state changes (" << state_changes_avoided / frames << " avoided), " << cpu_ms / frames << " cpu ms";
+			if(gpu_samples > 0) std::cout << ", " << gpu_ms / gpu_samples << " gpu ms";
+			std::cout << ", LOD triangles: ";
+			for(int l = 0; l < MAX_LODS; l++) std::cout << (l > 0 ? "/" : "") << lod_triangles[l] / frames;
+		}
+		std::cout << ", ring stalls: " << ring_stalls;
+		std::cout << "\n";
+		last_frames = frames_rendered;
+		last_time = now;
+		last_cpu = cpu;
+		draw_calls = triangles = state_changes = state_changes_avoided = gpu_samples = 0;
+		for(int l = 0; l < MAX_LODS; l++) lod_triangles[l] = 0;
+		cpu_ms = gpu_ms = 0.0;
+	}
+
+	void destroy() {
+		if(gpu_timer) glDeleteQueries(GPU_QUERY_FRAMES, queries);
+	}
+};
+
+const char* const skybox_dirs[3] = { "skybox/", "skybox2/", "skybox3/" };
+
+void print_skybox_cache(const CubemapCache &skyboxes) {
+	std::cout << skyboxes.resident_count() << " resident, " << skyboxes.resident_bytes / 1024 << " KB of " << skyboxes.budget / 1024 << " KB, "
+		<< skyboxes.hits << " hits, " << skyboxes.misses << " misses, " << skyboxes.evictions << " evicted";
+}
+
+//Skybox keys: dir is shown right away when it is resident, otherwise it is streamed in the background
+//and the current one stays on screen until it is complete
+void switch_skybox(CubemapCache &skyboxes, CubemapStreamer &streamer, const char* dir, GLuint &skybox_texture, std::string &shown_skybox, std::string &wanted_skybox) {
+	GLuint texture = skyboxes.find(dir);
+	if(texture != 0) {
+		skybox_texture = texture;
+		shown_skybox = dir;
+		wanted_skybox.clear();
+		std::cout << "Switched to " << dir << " (";
+		print_skybox_cache(skyboxes);
+		std::cout << ")\n";
+		return;
+	}
+	if(wanted_skybox != dir) std::cout << "Loading " << dir << " in the background\n";
+	wanted_skybox = dir;
+	streamer.request(dir, true);
+}
+
+//Starts loading the skybox after the shown one (1 -> 2 -> 3 -> 1), the likely next key press
+void prefetch_next_skybox(const CubemapCache &skyboxes, CubemapStreamer &streamer, const std::string &shown_skybox) {
+	for(int i = 0; i < 3; i++) {
+		if(shown_skybox == skybox_dirs[i]) {
+			const char* next = skybox_dirs[(i + 1) % 3];
+			if(!skyboxes.resident(next)) streamer.request(next, false);
+			return;
+		}
+	}
+}
+
+const int PIP_BENCH_SUBDIVISIONS = 4; //the sweep goes from 20 to 5120 triangles per pip
+
+//Frame time of the old per-pip path vs the instanced path for a growing number of dice, for every pip tessellation in sphere_meshes
+//(one per subdivision level). Dice are copies of the two scene dice laid out on a grid, the GPU work is the same for both paths.
+//False when the per-pip shader doesn't build
+bool run_pip_benchmark(GLFWwindow* window, GLuint sphere_shader, MeshPool &pool, const std::vector<MeshRange> &sphere_meshes, const glm::mat4 &sphere_matrix, const glm::mat4* pip_model_matrices, int scene_dice) {
+	const int dice_counts[3] = {2, 100, 10000};
+	const int frames = 50;
+
+	ShaderProgram uniform_shader;
+	if(!uniform_shader.build(sphere_uniform_vertex_shader, sphere_fragment_shader)) {
+		std::cerr << "Failed to build the per-pip shader, benchmark aborted." << std::endl;
+		return false;
+	}
+
+	glfwSwapInterval(0); //no vsync, we want the real frame time
+	std::cout << "subdivisions\tpip triangles\tdice\tpips\tper-pip ms\tinstanced ms\tdraws (per-pip/instanced)\n";
+	for(int d = 0; d < 3 * (int)sphere_meshes.size(); d++) {
+		const MeshRange &sphere_mesh = sphere_meshes[d / 3];
+		int dice = dice_counts[d % 3];
+		int pair_columns = (int)ceil(sqrt(dice / 2.0f));
+		std::vector<glm::mat4> pips(dice * PIPS_PER_DIE);
+		for(int i = 0; i < dice; i++) {
+			int pair = i / 2; //the scene dice come in pairs, keep them together
+			glm::vec3 offset((pair % pair_columns) * 3.2f, (pair / pair_columns) * -3.2f, 0.0f);
+			glm::mat4 shift = glm::translate(aux::mat4_identity, offset);
+			const glm::mat4* die_pips = &pip_model_matrices[(i % std::min(scene_dice, 2)) * PIPS_PER_DIE];
+			for(int p = 0; p < PIPS_PER_DIE; p++) {
+				pips[i * PIPS_PER_DIE + p] = shift * die_pips[p];
+			}
+		}
+		pool.reserve_instances(pips.size());
+		std::vector<DrawElementsIndirectCommand> command(1);
+		command[0] = { sphere_mesh.index_count, GLuint(pips.size()), sphere_mesh.first_index, sphere_mesh.base_vertex, 0 };
+		pool.set_commands(command);
+		void* first_index = pool.index_offset(sphere_mesh.first_index);
+
+		double frame_ms[2];
+		for(int path = 0; path < 2; path++) {
+			glFinish();
+			double start = glfwGetTime();
+			for(int f = 0; f < frames; f++) {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				if(path == 0) {
+					glUseProgram(uniform_shader.id);
+					glUniformMatrix4fv(uniform_shader.uniform("sphere_matrix"), 1, GL_FALSE, glm::value_ptr(sphere_matrix));
+					for(size_t p = 0; p < pips.size(); p++) {
+						glUniformMatrix4fv(uniform_shader.uniform("model_matrix"), 1, GL_FALSE, glm::value_ptr(pips[p]));
+						glBindVertexArray(pool.vao);
+						glDrawElementsBaseVertex(GL_TRIANGLES, sphere_mesh.index_count, pool.index_type, first_index, sphere_mesh.base_vertex);
+					}
+				} else {
+					glUseProgram(sphere_shader); //camera comes from the Camera block
+					pool.begin_frame();
+					pool.upload_instances(&pips[0], pips.size());
+					pool.draw(0, 1);
+					pool.end_frame();
+				}
+				glfwSwapBuffers(window);
+				glfwPollEvents();
+			}
+			glFinish();
+			frame_ms[path] = (glfwGetTime() - start) * 1000.0 / frames;
+		}
+		std::cout << d / 3 << "\t\t" << sphere_mesh.index_count / 3 << "\t\t" << dice << "\t" << pips.size() << "\t" << frame_ms[0] << "\t\t" << frame_ms[1] << "\t\t" << pips.size() << "/1\n";
+	}
+
+	uniform_shader.destroy();
+	return true;
+}
+
+//Writes the camera block into the next slice of its ring and points the Camera binding at it
+void upload_camera(StreamRing &ring, const CameraBlock &camera) {
+	ring.begin_frame();
+	ring.write(0, &camera, sizeof(CameraBlock));
+	ring.flush();
+	glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, ring.buffer, ring.offset(), sizeof(CameraBlock));
+}
+
+//Times the culling kernels on 1M objects scattered around the camera, prints the results and exits. No GL needed
+void run_cull_benchmark() {
+	const size_t objects = 1000000;
+	const int iterations = 20;
+	CullSet set;
+	set.resize(objects);
+	srand(1);
+	for(size_t i = 0; i < objects; i++) {
+		glm::vec3 position(rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f);
+		glm::mat4 world = glm::translate(aux::mat4_identity, position * 200.0f);
+		world = glm::rotate(world, rand() / (float)RAND_MAX * 6.2832f, glm::normalize(glm::vec3(1.0f, 2.0f, 3.0f)));
+		set.set(i, world, glm::vec3(-0.5f), glm::vec3(0.5f));
+	}
+	glm::mat4 view_projection = glm::perspective(aux::degrees_to_radians(45.0f), 1.0f, 0.1f, 100.0f) * glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = extract_frustum(view_projection);
+	std::vector<uint32_t> visible(objects);
+
+	typedef size_t (*CullKernel)(const Frustum&, const CullSet&, size_t, size_t, uint32_t*);
+	const char* names[3] = { "scalar", "sse", "avx" };
+	CullKernel kernels[3] = { cull_scalar, NULL, NULL };
+#if defined(__SSE2__)
+	kernels[1] = cull_sse;
+#endif
+#if defined(__AVX__)
+	kernels[2] = cull_avx;
+#endif
+	std::cout << "kernel	ms	objects/s	visible (of " << objects << ")\n";
+	for(int k = 0; k < 3; k++) {
+		if(kernels[k] == NULL) {
+			std::cout << names[k] << "\tnot compiled in\n";
+			continue;
+		}
+		size_t visible_count = 0;
+		double start = glfwGetTime();
+		for(int i = 0; i < iterations; i++) {
+			visible_count = kernels[k](frustum, set, 0, objects, &visible[0]);
+		}
+		double ms = (glfwGetTime() - start) * 1000.0 / iterations;
+		std::cout << names[k] << "\t" << ms << "\t" << objects / (ms / 1000.0) << "\t" << visible_count << "\n";
+	}
+}
+
+//Times one OBJ load with the native loader and, when built with Assimp, with Assimp
+void time_obj_load(const char* name, const std::string &file, int iterations, JobSystem &jobs) {
+	ObjModel model;
+	double start = glfwGetTime();
+	for(int i = 0; i < iterations; i++) {
+		load_obj(file, model, &jobs);
+	}
+	double native_ms = (glfwGetTime() - start) * 1000.0 / iterations;
+	std::cout << name << "\tnative\t" << native_ms << "\t" << model.indices.size() / 3 << " tris, " << model.positions.size() << " verts\n";
+#ifdef DICE_WITH_ASSIMP
+	std::vector<glm::vec3> vertices, normals, texcoords, tangents;
+	std::vector<unsigned int> indices;
+	start = glfwGetTime();
+	for(int i = 0; i < iterations; i++) {
+		vertices.clear(); normals.clear(); texcoords.clear(); tangents.clear(); indices.clear();
+		load_obj_file(file, vertices, normals, texcoords, tangents, indices);
+	}
+	double assimp_ms = (glfwGetTime() - start) * 1000.0 / iterations;
+	std::cout << name << "\tassimp\t" << assimp_ms << "\t" << indices.size() / 3 << " tris, " << vertices.size() << " verts (" << assimp_ms / native_ms << "x)\n";
+#else
+	std::cout << name << "\tassimp\tnot compiled in (make ASSIMP=1)\n";
+#endif
+}
+
+//Loads assets/die.obj and a generated 10M triangle grid, prints the times and exits. No GL needed
+void run_obj_benchmark(JobSystem &jobs) {
+	std::cout << "Parsing on " << jobs.thread_count() << " threads\nfile\tloader\tms\tresult\n";
+	time_obj_load("die.obj", "assets/die.obj", 20, jobs);
+
+	const int side = 2237; //2236 * 2236 * 2 = 10M triangles
+	const char* synthetic = "/tmp/dice_obj_bench.obj";
+	FILE* f = fopen(synthetic, "w");
+	if(f == NULL) {
+		std::cerr << "Failed to write " << synthetic << "\n";
+		return;
+	}
+	for(int y = 0; y < side; y++) {
+		for(int x = 0; x < side; x++) {
+			fprintf(f, "v %.4f %.4f %.4f\n", x / (float)side, y / (float)side, sinf(x * 0.1f) * cosf(y * 0.1f) * 0.05f);
+		}
+	}
+	for(int y = 0; y < side - 1; y++) {
+		for(int x = 0; x < side - 1; x++) {
+			int a = y * side + x + 1;
+			fprintf(f, "f %d %d %d\nf %d %d %d\n", a, a + 1, a + side + 1, a, a + side + 1, a + side);
+		}
+	}
+	fclose(f);
+	time_obj_load("10M grid", synthetic, 1, jobs);
+	remove(synthetic);
+}
+
+//Writes the same synthetic face six times as dir<face>.jpg
+bool write_bench_cubemap(const std::string &dir, int size) {
+	std::vector<unsigned char> pixels((size_t)size * size * 3);
+	for(int y = 0; y < size; y++) {
+		for(int x = 0; x < size; x++) {
+			unsigned char* p = &pixels[((size_t)y * size + x) * 3];
+			p[0] = x * 255 / size;
+			p[1] = y * 255 / size;
+			p[2] = (x ^ y) & 255;
+		}
+	}
+	std::vector<unsigned char> jpg;
+	stbi_write_jpg_to_func([](void* context, void* data, int bytes) {
+		std::vector<unsigned char>* out = (std::vector<unsigned char>*)context;
+		out->insert(out->end(), (unsigned char*)data, (unsigned char*)data + bytes);
+	}, &jpg, size, size, 3, &pixels[0], 90);
+	for(int face = 0; face < 6; face++) {
+		FILE* f = fopen(cube_face_path(dir.c_str(), face).c_str(), "wb");
+		if(f == NULL) return false;
+		fwrite(&jpg[0], 1, jpg.size(), f);
+		fclose(f);
+	}
+	return true;
+}
+
+//Decodes generated 512^2 to 4096^2 cubemaps one face after the other and on the job threads, into one
+//staging allocation, prints the times and exits. No GL needed
+void run_cubemap_benchmark(JobSystem &jobs) {
+	const int iterations = 3;
+	CubemapFaces staging;
+	int reallocations = 0;
+	std::cout << "Decoding on " << jobs.thread_count() << " threads\nface\tMB\tserial ms\tparallel ms\tMPix/s\tspeedup\n";
+	for(int size = 512; size <= 4096; size *= 2) {
+		std::string dir = "/tmp/dice_cubemap_bench_" + std::to_string(size) + "_";
+		if(!write_bench_cubemap(dir, size)) {
+			std::cerr << "Failed to write " << dir << "\n";
+			return;
+		}
+		double ms[2] = { 0.0, 0.0 };
+		for(int parallel = 0; parallel < 2; parallel++) {
+			double start = glfwGetTime();
+			for(int i = 0; i < iterations; i++) {
+				size_t capacity = staging.pixels.capacity();
+				if(!decode_cube_faces(dir.c_str(), 3, parallel ? &jobs : NULL, staging)) return;
+				if(staging.pixels.capacity() != capacity) reallocations++;
+			}
+			ms[parallel] = (glfwGetTime() - start) * 1000.0 / iterations;
+		}
+		double megapixels = 6.0 * size * size / 1e6;
+		std::cout << size << "\t" << staging.pixels.size() / (1024 * 1024) << "\t" << ms[0] << "\t\t" << ms[1] << "\t\t"
+			<< megapixels / (ms[1] / 1000.0) << "\t" << ms[0] / ms[1] << "x\n";
+		for(int face = 0; face < 6; face++) {
+			remove(cube_face_path(dir.c_str(), face).c_str());
+		}
+	}
+	std::cout << "Staging reallocations: " << reallocations << " (one per bigger size)\n";
+}
+
+//Root mean square error per channel of BC1 compressed faces against the source
+double dxt_rmse(const CubemapFaces &faces, const CompressedCubemap &compressed) {
+	double error = 0.0;
+	for(int face = 0; face < 6; face++) {
+		for(int y = 0; y < faces.height; y += 4) {
+			for(int x = 0; x < faces.width; x += 4) {
+				unsigned char decoded[64];
+				dxt_decompress_color_block(compressed.face(face) + (y / 4) * compressed.row_bytes() + (x / 4) * 8, decoded);
+				for(int i = 0; i < 16; i++) {
+					if(x + i % 4 >= faces.width || y + i / 4 >= faces.height) continue;
+					const unsigned char* p = faces.face(face) + ((size_t)(y + i / 4) * faces.width + x + i % 4) * 3;
+					for(int c = 0; c < 3; c++) {
+						double d = decoded[i * 4 + c] - p[c];
+						error += d * d;
+					}
+				}
+			}
+		}
+	}
+	return sqrt(error / (6.0 * faces.width * faces.height * 3));
 }
 
-int main() {
+//Compresses the three skyboxes to BC1 with every encoder on one thread, then with the widest one on the job threads,
+//prints the throughput, error and VRAM sizes and exits. No GL needed
+void run_dxt_benchmark(JobSystem &jobs) {
+	const char* dirs[3] = { "skybox/", "skybox2/", "skybox3/" };
+	CubemapFaces faces;
+	CompressedCubemap compressed;
+	std::cout << "skybox\tencoder\tthreads\tms\tMPix/s\tRMSE\n";
+	for(int d = 0; d < 3; d++) {
+		if(!decode_cube_faces(dirs[d], 3, &jobs, faces)) return;
+		double megapixels = 6.0 * faces.width * faces.height / 1e6;
+		for(int e = 0; e <= dxt_widest_encoder() + 1; e++) {
+			DxtEncoder encoder = e <= dxt_widest_encoder() ? (DxtEncoder)e : dxt_widest_encoder();
+			JobSystem* threads = e <= dxt_widest_encoder() ? NULL : &jobs;
+			double start = glfwGetTime();
+			compress_cube_faces(faces, encoder, threads, compressed);
+			double ms = (glfwGetTime() - start) * 1000.0;
+			std::cout << dirs[d] << "\t" << dxt_encoder_names[encoder] << "\t" << (threads ? jobs.thread_count() : 1) << "\t" << ms << "\t"
+				<< megapixels / (ms / 1000.0) << "\t" << dxt_rmse(faces, compressed) << "\n";
+		}
+		std::cout << dirs[d] << "\tVRAM\t" << faces.pixels.size() / 1024 << " KB as RGB, " << compressed.data.size() / 1024 << " KB as BC1 ("
+			<< faces.pixels.size() / compressed.data.size() << "x smaller)\n";
+	}
+}
+
+int main(int argc, char** argv) {
+	bool pip_bench = false;
+	bool on_demand = true;
+	bool print_stats = false;
+	bool headless = false;
+	long max_frames = 0;
+	VertexFormat vertex_format = VERTEX_UNORM16;
+	int transparency = TRANSPARENCY_OIT;
+	int dice_count = 2;
+	int layout = LAYOUT_PAIR;
+	bool frustum_culling = true;
+	bool cull_bench = false;
+	bool obj_bench = false;
+	bool cubemap_bench = false;
+	bool dxt_bench = false;
+	bool texture_compression = true;
+	int pip_subdivisions = ICOSPHERE_DEFAULT_SUBDIVISIONS;
+	float lod_error = 1.0f;
+	size_t skybox_budget = 32;
+	bool prefetch_skyboxes = false;
+	int thread_count = std::max(1, (int)std::thread::hardware_concurrency());
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--headless") == 0) headless = true;
+		if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc) max_frames = atol(argv[++i]);
+		if(strcmp(argv[i], "--pip-bench") == 0) pip_bench = true;
+		if(strcmp(argv[i], "--always-redraw") == 0) on_demand = false;
+		if(strcmp(argv[i], "--stats") == 0) print_stats = true;
+		if(strcmp(argv[i], "--no-cull") == 0) frustum_culling = false;
+		if(strcmp(argv[i], "--cull-bench") == 0) cull_bench = true;
+		if(strcmp(argv[i], "--obj-bench") == 0) obj_bench = true;
+		if(strcmp(argv[i], "--cubemap-bench") == 0) cubemap_bench = true;
+		if(strcmp(argv[i], "--dxt-bench") == 0) dxt_bench = true;
+		if(strcmp(argv[i], "--no-texture-compression") == 0) texture_compression = false;
+		if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) thread_count = std::max(1, atoi(argv[++i]));
+		if(strcmp(argv[i], "--pip-subdivisions") == 0 && i + 1 < argc) {
+			pip_subdivisions = atoi(argv[++i]);
+			if(pip_subdivisions < 0 || pip_subdivisions > ICOSPHERE_MAX_SUBDIVISIONS) {
+				std::cerr << "--pip-subdivisions must be between 0 and " << ICOSPHERE_MAX_SUBDIVISIONS << std::endl;
+				return 1;
+			}
+		}
+		if(strcmp(argv[i], "--skybox-budget") == 0 && i + 1 < argc) skybox_budget = atol(argv[++i]);
+		if(strcmp(argv[i], "--prefetch-skyboxes") == 0) prefetch_skyboxes = true;
+		if(strcmp(argv[i], "--lod-error") == 0 && i + 1 < argc) lod_error = std::max(0.0f, (float)atof(argv[++i]));
+		if(strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc) {
+			i++;
+			if(strcmp(argv[i], "float") == 0) vertex_format = VERTEX_FLOAT;
+			else if(strcmp(argv[i], "half") == 0) vertex_format = VERTEX_HALF;
+			else if(strcmp(argv[i], "unorm16") == 0) vertex_format = VERTEX_UNORM16;
+			else {
+				std::cerr << "Unknown vertex format " << argv[i] << ", expected float, half or unorm16" << std::endl;
+				return 1;
+			}
+		}
+		if(strcmp(argv[i], "--dice") == 0 && i + 1 < argc) {
+			dice_count = atoi(argv[++i]);
+			if(dice_count < 1 || dice_count > MAX_DICE) {
+				std::cerr << "--dice must be between 1 and " << MAX_DICE << std::endl;
+				return 1;
+			}
+			if(layout == LAYOUT_PAIR) layout = LAYOUT_GRID;
+		}
+		if(strcmp(argv[i], "--layout") == 0 && i + 1 < argc) {
+			i++;
+			if(strcmp(argv[i], "grid") == 0) layout = LAYOUT_GRID;
+			else if(strcmp(argv[i], "random") == 0) layout = LAYOUT_RANDOM;
+			else {
+				std::cerr << "Unknown layout " << argv[i] << ", expected grid or random" << std::endl;
+				return 1;
+			}
+		}
+		if(strcmp(argv[i], "--transparency") == 0 && i + 1 < argc) {
+			i++;
+			transparency = -1;
+			for(int m = 0; m < 3; m++) {
+				if(strcmp(argv[i], transparency_names[m]) == 0) transparency = m;
+			}
+			if(transparency == -1) {
+				std::cerr << "Unknown transparency mode " << argv[i] << ", expected blend, sorted or oit" << std::endl;
+				return 1;
+			}
+		}
+	}
+
 	if(!glfwInit()) {
 		std::cerr << "glfwInit failed." << std::endl;
 		return 1;
 	}
+	if(cull_bench) {
+		run_cull_benchmark();
+		glfwTerminate();
+		return 0;
+	}
+	//used for loading the meshes and the skybox and for recording the frames
+	JobSystem jobs;
+	jobs.start(thread_count);
+	if(obj_bench) {
+		run_obj_benchmark(jobs);
+		glfwTerminate();
+		return 0;
+	}
+	if(cubemap_bench) {
+		run_cubemap_benchmark(jobs);
+		glfwTerminate();
+		return 0;
+	}
+	if(dxt_bench) {
+		run_dxt_benchmark(jobs);
+		glfwTerminate();
+		return 0;
+	}
 
 	int win_width = 800;
 	int win_height = 800;
 	
+	if(headless) { //hidden window, renders --frames frames (default 1), saves the last one and exits
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		on_demand = false;
+		if(max_frames == 0) max_frames = 1;
+	}
 	GLFWwindow* window = glfwCreateWindow(win_width, win_height, "Project 2", NULL, NULL);
 	if(window == NULL) {
 		std::cerr << "Window creation failed." << std::endl;
@@ -313,6 +878,14 @@ int main() {
 		std::cerr << "glewInit failed." << std::endl;
 		return 1;
 	}
+	//the skyboxes are sRGB (cubemap.h), their S3TC formats come with EXT_texture_sRGB or EXT_texture_compression_s3tc_srgb
+	if(texture_compression && (!GLEW_EXT_texture_compression_s3tc || (!GLEW_EXT_texture_sRGB && !glewIsSupported("GL_EXT_texture_compression_s3tc_srgb")))) {
+		std::cout << "No sRGB S3TC texture compression, the skyboxes are uploaded uncompressed\n";
+		texture_compression = false;
+	}
+	if(GLEW_VERSION_3_2 || GLEW_ARB_seamless_cube_map) { //the skybox mips are filtered across the face edges
+		glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	}
 	
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
@@ -322,224 +895,281 @@ int main() {
 	
 	int screenshot_number = 0;
 	
-	// MESH LOADING
-	std::vector<glm::vec3> cube_vertices;
-	std::vector<glm::vec3> cube_normals;
-	std::vector<glm::vec3> cube_texcoords;
-	std::vector<glm::vec3> cube_tangents;
-	std::vector<unsigned int> cube_indices;
-	int cube_v_total = load_obj_file("assets/cube.obj", cube_vertices, cube_normals, cube_texcoords, cube_tangents, cube_indices);
-	if(cube_v_total == -1) {
-		std::cerr << "Failed to load .obj file." << std::endl;
-		return 1;
+	// STARTUP LOADING
+	// Skybox cube, die and sphere share one VAO, one vertex buffer and one index buffer. Each mesh comes from its
+	// binary cache when it is up to date (warm), otherwise the OBJ is parsed and the cache written (cold).
+	// The meshes and the six skybox faces are read on the job threads while this thread generates the pips,
+	// then this thread adds each mesh to the pool and uploads each face as soon as its job is done.
+	// With texture compression the face jobs also block compress their face, unless the skybox's dxt cache
+	// is up to date: then there are no face jobs and this thread uploads the cached faces
+	MeshPool pool;
+	pool.format = vertex_format;
+	const char* mesh_files[2] = { "assets/cube.obj", "assets/die.obj" };
+	const char* mesh_names[3] = { "Skybox", "Die", "Sphere" };
+	MeshRange mesh_ranges[3];
+	MeshData mesh_data[2];
+	CubemapFaces skybox_faces;
+	CompressedCubemap skybox_compressed;
+	double mip_ms[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+	double compress_ms[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+	StartupTimeline timeline;
+	for(int m = 0; m < 2; m++) {
+		timeline.add(mesh_files[m]);
 	}
-	std::cout << "Loaded Skybox Mesh\n";
-
-	std::vector<glm::vec3> die_vertices;
-	std::vector<glm::vec3> die_normals;
-	std::vector<glm::vec3> die_texcoords;
-	std::vector<glm::vec3> die_tangents;
-	std::vector<unsigned int> die_indices;
-	int die_v_total = load_obj_file("assets/die.obj", die_vertices, die_normals, die_texcoords, die_tangents, die_indices);
-	if(die_v_total == -1) {
-		std::cerr << "Failed to load .obj file." << std::endl;
-		return 1;
+	int sphere_job = timeline.add("sphere");
+	int cache_job = -1;
+	bool skybox_cached = false;
+	if(texture_compression) {
+		cache_job = timeline.add(dxt_cache_path("skybox/"));
+		timeline.started(cache_job);
+		skybox_cached = read_dxt_cache("skybox/", skybox_compressed);
+		timeline.finished(cache_job, skybox_cached);
 	}
-	std::cout << "Loaded Die Mesh\n";
-
-	std::vector<glm::vec3> sphere_vertices;
-	std::vector<glm::vec3> sphere_normals;
-	std::vector<glm::vec3> sphere_texcoords;
-	std::vector<glm::vec3> sphere_tangents;
-	std::vector<unsigned int> sphere_indices;
-	int sphere_v_total = load_obj_file("assets/sphere.obj", sphere_vertices, sphere_normals, sphere_texcoords, sphere_tangents, sphere_indices);
-	if(sphere_v_total == -1) {
-		std::cerr << "Failed to load .obj file." << std::endl;
-		return 1;
+	int face_jobs = 0;
+	if(!skybox_cached) { //every face header is checked before anything is decoded or uploaded
+		if(!prepare_cube_faces("skybox/", 0, skybox_faces, true)) {
+			std::cerr << "Failed to load textures. Exiting.\n";
+			return 1;
+		}
+		if(texture_compression && cube_faces_compressible(skybox_faces)) {
+			prepare_compressed_cubemap(skybox_faces, skybox_compressed);
+		}
+		for(int f = 0; f < 6; f++) {
+			timeline.add(std::string("skybox/") + cube_face_names[f] + ".jpg");
+		}
+		face_jobs = 6;
 	}
-	std::cout << "Loaded Sphere Mesh\n";
-	
-	// SKYBOX TEXTURE LOADING
-	GLuint skybox_texture = load_cube_tex("skybox/", 0);
-	if(skybox_texture == -1) {
-		std::cerr << "Failed to load textures. Exiting.\n";
+	int first_face_job = sphere_job + (cache_job != -1 ? 2 : 1);
+	std::function<void(int)> startup_job = [&](int j) { //the job threads are all busy here, so the OBJ parser gets none
+		int job = j < 2 ? j : first_face_job + j - 2;
+		timeline.started(job);
+		bool ok;
+		if(j < 2) {
+			ok = read_mesh(mesh_files[j], pool, NULL, mesh_data[j]);
+		} else {
+			ok = decode_cube_face("skybox/", j - 2, skybox_faces);
+			if(ok) {
+				double start = timeline.now_ms();
+				generate_face_mips(skybox_faces, j - 2);
+				mip_ms[j - 2] = timeline.now_ms() - start;
+			}
+			if(ok && skybox_compressed.format != 0) {
+				double start = timeline.now_ms();
+				compress_cube_face(skybox_faces, j - 2, dxt_widest_encoder(), skybox_compressed);
+				compress_ms[j - 2] = timeline.now_ms() - start;
+			}
+		}
+		timeline.finished(job, ok);
+	};
+	jobs.run_async(2 + face_jobs, startup_job);
+
+	// The pips are an icosphere generated here, --pip-bench also gets every level up to PIP_BENCH_SUBDIVISIONS
+	timeline.started(sphere_job);
+	IcosphereCache spheres;
+	mesh_ranges[2] = spheres.get(pool, pip_subdivisions);
+	std::vector<MeshRange> bench_spheres;
+	for(int s = 0; pip_bench && s <= PIP_BENCH_SUBDIVISIONS; s++) {
+		bench_spheres.push_back(spheres.get(pool, s));
+	}
+	timeline.finished(sphere_job, true);
+
+	GLuint skybox_texture;
+	glGenTextures(1, &skybox_texture);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture);
+	bool loaded = true;
+	for(int j = timeline.next_finished(); j != -1; j = timeline.next_finished()) {
+		if(j == sphere_job || (j == cache_job && !skybox_cached)) continue;
+		if(!timeline.ok(j)) {
+			loaded = false;
+			continue;
+		}
+		double upload_start = timeline.now_ms();
+		if(j < 2) {
+			mesh_ranges[j] = add_mesh_data(pool, mesh_data[j], true);
+		} else if(j == cache_job) {
+			for(int f = 0; f < 6; f++) {
+				upload_compressed_face(f, skybox_compressed);
+			}
+		} else if(skybox_compressed.format != 0) {
+			upload_compressed_face(j - first_face_job, skybox_compressed);
+		} else {
+			upload_cube_face(j - first_face_job, skybox_faces);
+		}
+		timeline.uploaded(j, upload_start);
+	}
+	jobs.wait();
+	if(!loaded) {
+		std::cerr << "Failed to load the meshes or the skybox. Exiting.\n";
 		return 1;
 	}
-	std::cout << "Loaded SkyBox Texture\n";
-	
-	// SKYBOX VBO
-	GLuint skybox_vbo = 0;
-	glGenBuffers(1, &skybox_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, skybox_vbo);
-	glBufferData(GL_ARRAY_BUFFER, cube_vertices.size() * sizeof(cube_vertices[0]), &cube_vertices[0], GL_STATIC_DRAW);
-	
-	// SKYBOX VAO
-	GLuint skybox_vao = 0;
-	glGenVertexArrays(1, &skybox_vao);
-	glBindVertexArray(skybox_vao);
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, skybox_vbo);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	
-	// DIE VBO
-	GLuint die_vertex_vbo = 0;
-	glGenBuffers(1, &die_vertex_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, die_vertex_vbo);
-	glBufferData(GL_ARRAY_BUFFER, die_vertices.size() * sizeof(die_vertices[0]), &die_vertices[0], GL_STATIC_DRAW);
-	GLuint die_normals_vbo = 0;
-	glGenBuffers(1, &die_normals_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, die_normals_vbo);
-	glBufferData(GL_ARRAY_BUFFER, die_normals.size() * sizeof(die_normals[0]), &die_normals[0], GL_STATIC_DRAW);
-	GLuint die_color_vbo = 0;
-	glGenBuffers(1, &die_color_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, die_color_vbo);
-	glBufferData(GL_ARRAY_BUFFER, die_texcoords.size() * sizeof(die_texcoords[0]), &die_texcoords[0], GL_STATIC_DRAW);
-	GLuint die_i_vbo = 0;
-	glGenBuffers(1, &die_i_vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, die_i_vbo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, die_indices.size() * sizeof(die_indices[0]), &die_indices[0], GL_STATIC_DRAW);
+	if(skybox_compressed.format != 0 && !skybox_cached) {
+		write_dxt_cache("skybox/", skybox_compressed);
+	}
+	int skybox_levels = skybox_cached ? skybox_compressed.levels : skybox_faces.levels;
+	set_cube_filtering(skybox_levels);
+
+	double cold_ms = 0.0, warm_ms = 0.0;
+	for(int m = 0; m < 2; m++) {
+		const MeshOptimizeStats &optimized = mesh_data[m].stats;
+		double ms = timeline.duration_ms(m);
+		(mesh_data[m].from_cache ? warm_ms : cold_ms) += ms;
+		std::cout << "Loaded " << mesh_names[m] << " Mesh (" << (mesh_data[m].from_cache ? "cache" : "parsed") << ", " << ms << " ms, " << mesh_ranges[m].submesh_count << " submeshes:";
+		for(GLuint s = 0; s < mesh_ranges[m].submesh_count; s++) {
+			const Submesh &submesh = pool.submeshes[mesh_ranges[m].first_submesh + s];
+			std::cout << " " << (submesh.material >= 0 ? pool.material_names[submesh.material] : "none") << " " << submesh.index_count / 3;
+		}
+		std::cout << ")\n";
+		std::cout << "    vertices " << optimized.vertices_before << " -> " << optimized.vertices_after << ", ACMR " << optimized.acmr_before << " -> " << optimized.acmr_after
+			<< ", ATVR " << optimized.atvr_before << " -> " << optimized.atvr_after << "\n";
+		const LoadArena &arena = mesh_data[m].arena;
+		std::cout << "    arena: " << arena.requests.allocations << " allocations, " << arena.requests.frees << " reallocations, "
+			<< arena.requests.bytes / 1024 << " KB in " << arena.blocks.allocations << " blocks\n";
+		std::cout << "    scratch: " << arena.scratch.allocations << " allocations, " << arena.scratch.peak_bytes / 1024 << " KB peak, "
+			<< arena.scratch_blocks.allocations << " blocks from the heap\n";
+	}
+	std::cout << "Mesh loading: " << warm_ms << " ms from cache, " << cold_ms << " ms parsing\n";
+	std::cout << "Generated Sphere Mesh (" << pip_subdivisions << " subdivisions, " << timeline.duration_ms(sphere_job) << " ms, "
+		<< mesh_ranges[2].index_count / 3 << " triangles)\n";
+	for(int m = 0; m < 3; m++) {
+		std::cout << mesh_names[m] << " LODs:";
+		for(GLuint l = 0; l < mesh_ranges[m].lod_count; l++) {
+			std::cout << " " << mesh_ranges[m].lods[l].index_count / 3 << " (" << mesh_ranges[m].lods[l].error << ")";
+		}
+		if(mesh_ranges[m].lod_count < LOD_MIN_LEVELS) {
+			std::cout << ", stops early: too few triangles to halve";
+		}
+		std::cout << "\n";
+	}
+	std::cout << "Loaded SkyBox Texture (" << skybox_levels << " mip levels";
+	if(!skybox_cached) {
+		double ms = 0.0;
+		for(int f = 0; f < 6; f++) ms += mip_ms[f];
+		std::cout << ", generated in " << ms << " ms";
+	}
+	if(skybox_compressed.format != 0) {
+		//against what the uncompressed GL_SRGB8 texture takes
+		size_t pixels = 0;
+		for(int l = 0; l < skybox_compressed.levels; l++) {
+			pixels += (size_t)6 * skybox_compressed.level_width(l) * skybox_compressed.level_height(l);
+		}
+		size_t raw_bytes = pixels * (skybox_compressed.format == GL_COMPRESSED_SRGB_S3TC_DXT1_EXT ? 3 : 4);
+		size_t compressed_bytes = skybox_compressed.data.size();
+		std::cout << ", " << (skybox_compressed.format == GL_COMPRESSED_SRGB_S3TC_DXT1_EXT ? "BC1" : "BC3") << ", " << compressed_bytes / 1024 << " KB instead of "
+			<< raw_bytes / 1024 << " KB, " << raw_bytes / compressed_bytes << "x smaller in VRAM, ";
+		if(skybox_cached) {
+			std::cout << "from " << dxt_cache_path("skybox/");
+		} else {
+			double ms = 0.0;
+			for(int f = 0; f < 6; f++) ms += compress_ms[f];
+			std::cout << "compressed at " << pixels / 1e6 / (ms / 1000.0) << " MPix/s per thread with "
+				<< dxt_encoder_names[dxt_widest_encoder()];
+		}
+		skybox_compressed = CompressedCubemap();
+	}
+	std::cout << ")\n";
+	timeline.print();
+	CubemapCache skyboxes;
+	skyboxes.budget = skybox_budget * 1024 * 1024;
+	skyboxes.insert("skybox/", skybox_texture);
+	CubemapStreamer skybox_streamer;
+	skybox_streamer.compress = texture_compression;
+	skybox_streamer.on_decoded = glfwPostEmptyEvent;
+	skybox_streamer.reuse(skybox_faces);
+	skybox_streamer.start();
+	std::string shown_skybox = "skybox/";
+	std::string wanted_skybox; //being streamed in to replace the shown one, empty when none
+	if(prefetch_skyboxes) prefetch_next_skybox(skyboxes, skybox_streamer, shown_skybox);
+	MeshRange cube_mesh = mesh_ranges[0];
+	MeshRange die_mesh = mesh_ranges[1];
+	MeshRange sphere_mesh = mesh_ranges[2];
 	
-	// DIE VAO
-	GLuint die_vao = 0;
-	glGenVertexArrays(1, &die_vao);
-	glBindVertexArray(die_vao);
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, die_vertex_vbo);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, die_normals_vbo);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(2);
-	glBindBuffer(GL_ARRAY_BUFFER, die_color_vbo);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(4);
-	glBindBuffer(GL_ARRAY_BUFFER, die_i_vbo);
-	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-
-	// SPHERE VBO
-	GLuint sphere_vertex_vbo = 0;
-	glGenBuffers(1, &sphere_vertex_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, sphere_vertex_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sphere_vertices.size() * sizeof(sphere_vertices[0]), &sphere_vertices[0], GL_STATIC_DRAW);
-	GLuint sphere_color_vbo = 0;
-	glGenBuffers(1, &sphere_color_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, sphere_color_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sphere_texcoords.size() * sizeof(sphere_texcoords[0]), &sphere_texcoords[0], GL_STATIC_DRAW);
-	GLuint sphere_i_vbo = 0;
-	glGenBuffers(1, &sphere_i_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, sphere_i_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sphere_indices.size() * sizeof(sphere_indices[0]), &sphere_indices[0], GL_STATIC_DRAW);
-
-	GLuint sphere_vao = 0;
-	glGenVertexArrays(1, &sphere_vao);
-	glBindVertexArray(sphere_vao);
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, sphere_vertex_vbo);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, sphere_color_vbo);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(2);
-	glBindBuffer(GL_ARRAY_BUFFER, sphere_i_vbo);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	// MESH POOL
+	const int pip_count = dice_count * PIPS_PER_DIE;
+	pool.upload(1 + dice_count + pip_count);
+	for(int m = 0; m < 2; m++) { //their vertices were uploaded from where they were read, the cache mapping when cached
+		mesh_data[m].release();
+	}
+	if(pool.multi_draw_indirect) {
+		std::cout << "Drawing with glMultiDrawElementsIndirect\n";
+	} else {
+		std::cout << "No GL 4.3, draw commands are replayed one by one\n";
+	}
 	
 	// CREATE SHADER PROGRAMS ////////////////////////////////////////
-	GLuint die_vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(die_vs, 1, &die_vertex_shader, NULL);
-    glCompileShader(die_vs);
-    GLuint die_fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(die_fs, 1, &die_fragment_shader, NULL);
-    glCompileShader(die_fs);
-    GLuint die_shader = glCreateProgram();
-    glAttachShader(die_shader, die_vs);
-    glAttachShader(die_shader, die_fs);
-    glLinkProgram(die_shader);
-    
-    GLuint skybox_vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(skybox_vs, 1, &skybox_vertex_shader, NULL);
-    glCompileShader(skybox_vs);
-    GLuint skybox_fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(skybox_fs, 1, &skybox_fragment_shader, NULL);
-    glCompileShader(skybox_fs);
-    GLuint skybox_shader = glCreateProgram();
-    glAttachShader(skybox_shader, skybox_vs);
-    glAttachShader(skybox_shader, skybox_fs);
-    glLinkProgram(skybox_shader);
-
-	GLuint sphere_vs = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(sphere_vs, 1, &sphere_vertex_shader, NULL);
-	glCompileShader(sphere_vs);
-	GLuint sphere_fs = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(sphere_fs, 1, &sphere_fragment_shader, NULL);
-	glCompileShader(sphere_fs);
-	GLuint sphere_shader = glCreateProgram();
-	glAttachShader(sphere_shader, sphere_vs);
-	glAttachShader(sphere_shader, sphere_fs);
-	glLinkProgram(sphere_shader);
+	ShaderProgram die_shader;
+	ShaderProgram skybox_shader;
+	ShaderProgram sphere_shader;
+	ShaderProgram die_oit_shader;
+	if(!die_shader.build(die_vertex_shader, die_fragment_shader) || !skybox_shader.build(skybox_vertex_shader, skybox_fragment_shader) || !sphere_shader.build(sphere_vertex_shader, sphere_fragment_shader) || !die_oit_shader.build(die_vertex_shader, die_oit_fragment_shader)) {
+		std::cerr << "Failed to build shader programs." << std::endl;
+		return 1;
+	}
+
+	// ORDER INDEPENDENT TRANSPARENCY
+	WeightedBlendedOIT oit;
+	if(!oit.init()) {
+		std::cerr << "Failed to build OIT resolve shader." << std::endl;
+		return 1;
+	}
+	if(!oit.supported && transparency == TRANSPARENCY_OIT) {
+		std::cout << "No per target blending (GL 4.0), using sorted transparency\n";
+		transparency = TRANSPARENCY_SORTED;
+	}
+
+	// CAMERA UBO, shared by all the programs and written once per frame into its own slice of a ring
+	StreamRing camera_ring;
+	camera_ring.create(GL_UNIFORM_BUFFER, sizeof(CameraBlock));
+	die_shader.bind_uniform_block("Camera", CAMERA_BLOCK_BINDING);
+	skybox_shader.bind_uniform_block("Camera", CAMERA_BLOCK_BINDING);
+	sphere_shader.bind_uniform_block("Camera", CAMERA_BLOCK_BINDING);
+	die_oit_shader.bind_uniform_block("Camera", CAMERA_BLOCK_BINDING);
     //////////////////////////////////////////////////////////////////
     
-    glm::mat4 skybox_model_matrix = glm::mat4(1.0f);
-
-	glm::mat4 model_matrix = glm::translate(aux::mat4_identity, glm::vec3(-0.8f, 0.0f, 0.0f));
-	glm::mat4 sphere_model_matrix = glm::translate(aux::mat4_identity, glm::vec3(-0.8f, 0.0f, 0.0f));
-
-	glm::mat4 model_matrix2 = glm::translate(aux::mat4_identity, glm::vec3(0.8f, 0.0f, 0.0f));
-	glm::mat4 sphere_model_matrix2 = glm::translate(aux::mat4_identity, glm::vec3(0.8f, 0.0f, 0.0f));
-
-	model_matrix = glm::rotate(model_matrix, aux::degrees_to_radians(-15.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	model_matrix2 = glm::rotate(model_matrix2, aux::degrees_to_radians(14.3f), glm::vec3(0.0f, 0.0f, 1.0f));
-
-	sphere_model_matrix = glm::rotate(sphere_model_matrix, aux::degrees_to_radians(-15.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	sphere_model_matrix2 = glm::rotate(sphere_model_matrix2, aux::degrees_to_radians(14.3f), glm::vec3(0.0f, 0.0f, 1.0f));
-
-	sphere_model_matrix = glm::scale(sphere_model_matrix, glm::vec3(0.1f, 0.1f, 0.1f));
-	glm::mat4 sphere1_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(0.0f, 0.0f, 6.0f));
-	glm::mat4 sphere21_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(6.0f, 3.0f, -3.0f));
-	glm::mat4 sphere22_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(6.0f, -3.0f, 3.0f));
-	glm::mat4 sphere31_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(3.0f, 6.0f, -3.0f));
-	glm::mat4 sphere32_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(0.0f, 6.0f, 0.0f));
-	glm::mat4 sphere33_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-3.0f, 6.0f, 3.0f));
-	glm::mat4 sphere41_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-3.0f, -6.0f, 3.0f));
-	glm::mat4 sphere42_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(3.0f, -6.0f, -3.0f));
-	glm::mat4 sphere43_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-3.0f, -6.0f, -3.0f));
-	glm::mat4 sphere44_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(3.0f, -6.0f, 3.0f));
-	glm::mat4 sphere51_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-6.0f, -3.0f, 3.0f));
-	glm::mat4 sphere52_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-6.0f, -3.0f, -3.0f));
-	glm::mat4 sphere53_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-6.0f, 3.0f, 3.0f));
-	glm::mat4 sphere54_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-6.0f, 3.0f, -3.0f));
-	glm::mat4 sphere55_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-6.0f, 0.0f, 0.0f));
-	glm::mat4 sphere61_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-3.0f, -3.0f, -6.0f));
-	glm::mat4 sphere62_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-3.0f, 0.0f, -6.0f));
-	glm::mat4 sphere63_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-3.0f, 3.0f, -6.0f));
-	glm::mat4 sphere64_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(3.0f, -3.0f, -6.0f));
-	glm::mat4 sphere65_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(3.0f, 0.0f, -6.0f));
-	glm::mat4 sphere66_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(3.0f, 3.0f, -6.0f));
-
-	sphere_model_matrix2 = glm::scale(sphere_model_matrix2, glm::vec3(0.1f, 0.1f, 0.1f));
-	glm::mat4 sphere1_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(0.0f, 0.0f, 6.0f));
-	glm::mat4 sphere21_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(6.0f, 3.0f, -3.0f));
-	glm::mat4 sphere22_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(6.0f, -3.0f, 3.0f));
-	glm::mat4 sphere31_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(3.0f, 6.0f, -3.0f));
-	glm::mat4 sphere32_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(0.0f, 6.0f, 0.0f));
-	glm::mat4 sphere33_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-3.0f, 6.0f, 3.0f));
-	glm::mat4 sphere41_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-3.0f, -6.0f, 3.0f));
-	glm::mat4 sphere42_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(3.0f, -6.0f, -3.0f));
-	glm::mat4 sphere43_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-3.0f, -6.0f, -3.0f));
-	glm::mat4 sphere44_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(3.0f, -6.0f, 3.0f));
-	glm::mat4 sphere51_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-6.0f, -3.0f, 3.0f));
-	glm::mat4 sphere52_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-6.0f, -3.0f, -3.0f));
-	glm::mat4 sphere53_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-6.0f, 3.0f, 3.0f));
-	glm::mat4 sphere54_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-6.0f, 3.0f, -3.0f));
-	glm::mat4 sphere55_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-6.0f, 0.0f, 0.0f));
-	glm::mat4 sphere61_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-3.0f, -3.0f, -6.0f));
-	glm::mat4 sphere62_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-3.0f, 0.0f, -6.0f));
-	glm::mat4 sphere63_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-3.0f, 3.0f, -6.0f));
-	glm::mat4 sphere64_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(3.0f, -3.0f, -6.0f));
-	glm::mat4 sphere65_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(3.0f, 0.0f, -6.0f));
-	glm::mat4 sphere66_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(3.0f, 3.0f, -6.0f));
+	// SCENE GRAPH
+	// root (arrow keys/orbit rotation) -> skybox, dice -> pips of each die.
+	// All pips are added last and in die order so their world matrices are one contiguous
+	// block, that block is exactly what goes in the pip instance buffer
+	SceneGraph scene;
+	int root_node = scene.add_node(SceneGraph::NO_PARENT, aux::mat4_identity);
+	int skybox_node = scene.add_node(root_node, aux::mat4_identity);
+	std::vector<glm::mat4> die_matrices = make_dice_layout(dice_count, layout);
+	std::vector<int> die_nodes(dice_count);
+	for(int i = 0; i < dice_count; i++) {
+		die_nodes[i] = scene.add_node(root_node, die_matrices[i]);
+	}
+	int first_pip_node = scene.size();
+	for(int i = 0; i < dice_count; i++) {
+		for(int p = 0; p < PIPS_PER_DIE; p++) {
+			glm::mat4 pip_matrix = glm::scale(aux::mat4_identity, glm::vec3(0.1f, 0.1f, 0.1f));
+			scene.add_node(die_nodes[i], glm::translate(pip_matrix, pip_offsets[p]));
+		}
+	}
+	scene.update();
+
+	// DRAW COMMANDS
+	// Pool instance i is scene node i + 1 (the root is never drawn), so base_instance is node - 1.
+	// The pip and die commands cover every instance of their mesh, the per frame commands recorded below
+	// draw parts of these ranges
+	const int SKYBOX_COMMAND = 0;
+	const int PIP_COMMAND = 1;
+	const int DIE_COMMAND = 2;
+	std::vector<DrawElementsIndirectCommand> commands(3);
+	commands[SKYBOX_COMMAND] = { cube_mesh.index_count, 1, cube_mesh.first_index, cube_mesh.base_vertex, GLuint(skybox_node - 1) };
+	commands[PIP_COMMAND] = { sphere_mesh.index_count, GLuint(pip_count), sphere_mesh.first_index, sphere_mesh.base_vertex, GLuint(first_pip_node - 1) };
+	commands[DIE_COMMAND] = { die_mesh.index_count, GLuint(dice_count), die_mesh.first_index, die_mesh.base_vertex, GLuint(die_nodes[0] - 1) };
+	pool.set_commands(commands);
+
+	// FRUSTUM CULLING
+	// Bounds of every die and pip (dice first), refreshed whenever the scene graph changes
+	CullSet cull_set;
+	cull_set.resize(dice_count + pip_count);
+	std::vector<uint32_t> visible(dice_count + pip_count);
+	const int die_base = die_nodes[0] - 1;
+	const int pip_base = first_pip_node - 1;
+	bool bounds_stale = true;
+	RenderQueue queue;
     
 	glm::vec3 die_camera_position = {0.0f, 0.0f, 5.0f};
-	glm::vec3 skybox_cam_position = {0.0f, 0.0f, 0.7f};
 
 	PROJECTION projection_info[1] = {
 		{aux::degrees_to_radians(45.0f), aux::get_aspect_ratio(win_width, win_height), 0.1f, 100.0f}
@@ -553,343 +1183,290 @@ int main() {
 	glm::mat4 projection_matrix = glm::perspective(projection_info[0].fov, projection_info[0].aspect_ratio, projection_info[0].near, projection_info[0].far);
 	glm::mat4 die_view_matrix = glm::lookAt(view_info[0].position, view_info[0].lookAt, view_info[0].axis);
 	glm::mat4 skybox_view_matrix = glm::lookAt(view_info[1].position, view_info[1].lookAt, view_info[1].axis);
-	glm::mat4 sphere_view_matrix = glm::lookAt(view_info[2]. position, view_info[2].lookAt, view_info[2].axis);
 
-	glm::mat4 skybox_matrix;
-	glm::mat4 die_matrix;
-	glm::mat4 sphere_matrix;
+	CameraBlock camera;
+	camera.projection_matrix = projection_matrix;
+	camera.view_matrix = die_view_matrix; //dice and pips share the same view
+	camera.skybox_view_matrix = skybox_view_matrix;
+	camera.camera_position = glm::vec4(die_camera_position, 1.0f);
+	upload_camera(camera_ring, camera);
+	camera_ring.end_frame();
+
+	if(pip_bench) {
+		bool benchmarked = run_pip_benchmark(window, sphere_shader.id, pool, bench_spheres, projection_matrix * die_view_matrix, scene.world_array(first_pip_node), dice_count);
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return benchmarked ? 0 : 1;
+	}
+
+	// COMMAND RECORDING
+	// The dice are split in chunks. A chunk updates the world matrices of its dice and their pips, culls them, writes
+	// the visible ones packed at the start of its part of the instance ranges and records its draws in its own list.
+	// Chunks run on the job threads, the GL thread then replays the lists in chunk order
+	const int dice_per_chunk = std::max(64, (dice_count + jobs.thread_count() * 4 - 1) / (jobs.thread_count() * 4));
+	const int chunk_count = (dice_count + dice_per_chunk - 1) / dice_per_chunk;
+	std::vector<CommandList> chunk_lists(chunk_count);
+	std::cout << "Recording " << chunk_count << " chunks on " << jobs.thread_count() << " threads\n";
+	Frustum frustum;
+	glm::mat4* instances = NULL;
+	bool scene_changed = false;
+	bool refresh_bounds = false;
+	LodView lod_view;
+	lod_view.max_pixels = lod_error;
+	std::vector<unsigned char> instance_lods(dice_count + pip_count); //each visible instance's level this frame, on every path
+	std::function<void(int)> record_chunk = [&](int c) {
+		int first_die = c * dice_per_chunk;
+		int last_die = std::min(dice_count, first_die + dice_per_chunk);
+		int first_pip = first_die * PIPS_PER_DIE;
+		int last_pip = last_die * PIPS_PER_DIE;
+		if(scene_changed) { //the root was done before the chunks started, each die's pips only depend on the die
+			scene.update_range(die_nodes[first_die], die_nodes[0] + last_die);
+			scene.update_range(first_pip_node + first_pip, first_pip_node + last_pip);
+		}
+		int visible_dice = last_die - first_die;
+		int visible_pips = last_pip - first_pip;
+		if(frustum_culling) {
+			if(refresh_bounds) {
+				for(int i = first_die; i < last_die; i++) {
+					cull_set.set(i, scene.world(die_nodes[i]), die_mesh.bounds_min, die_mesh.bounds_max);
+				}
+				for(int i = first_pip; i < last_pip; i++) {
+					cull_set.set(dice_count + i, scene.world(first_pip_node + i), sphere_mesh.bounds_min, sphere_mesh.bounds_max);
+				}
+			}
+			visible_dice = cull(frustum, cull_set, first_die, last_die - first_die, &visible[first_die]);
+			visible_pips = cull(frustum, cull_set, dice_count + first_pip, last_pip - first_pip, &visible[dice_count + first_pip]);
+		}
+		//instances are packed by LOD inside the chunk's range, one draw per level that has any
+		std::function<glm::mat4(int)> die_world = [&](int k) { return scene.world(die_nodes[frustum_culling ? visible[first_die + k] : first_die + k]); };
+		std::function<glm::mat4(int)> pip_world = [&](int k) { return scene.world(first_pip_node + (frustum_culling ? visible[dice_count + first_pip + k] - dice_count : first_pip + k)); };
+		GLuint pip_lods[MAX_LODS];
+		pack_instances_by_lod(sphere_mesh, visible_pips, pip_world, lod_view, &instances[pip_base + first_pip], &instance_lods[dice_count + first_pip], pip_lods);
+
+		CommandList &list = chunk_lists[c];
+		list.clear();
+		RenderItem pip_state = { PASS_OPAQUE, sphere_shader.id, 0, pool.vao, true, CULL_NONE, 0, 0, 0.0f, 0 };
+		GLuint first_instance = pip_base + first_pip;
+		for(int l = 0; l < MAX_LODS; l++) {
+			if(pip_lods[l] == 0) continue;
+			const MeshLod &lod = sphere_mesh.lods[l];
+			list.draw(pip_state, { lod.index_count, pip_lods[l], lod.first_index, sphere_mesh.base_vertex, first_instance });
+			first_instance += pip_lods[l];
+		}
+		if(transparency == TRANSPARENCY_SORTED) {
+			//one packet per die and face, the sort key puts the farthest die first and its back faces before its front faces
+			for(int k = 0; k < visible_dice; k++) {
+				glm::mat4 world = die_world(k);
+				instances[die_base + first_die + k] = world;
+				float depth = -(die_view_matrix * world)[3].z;
+				RenderItem back_faces = { PASS_TRANSPARENT, die_shader.id, skybox_texture, pool.vao, true, CULL_FRONT, 0, 0, depth, 0 };
+				RenderItem front_faces = back_faces;
+				front_faces.cull = CULL_BACK;
+				front_faces.order = 1;
+				instance_lods[first_die + k] = select_lod(die_mesh, world, lod_view);
+				const MeshLod &lod = die_mesh.lods[instance_lods[first_die + k]];
+				DrawElementsIndirectCommand die_command = { lod.index_count, 1, lod.first_index, die_mesh.base_vertex, GLuint(die_base + first_die + k) };
+				list.draw(back_faces, die_command);
+				list.draw(front_faces, die_command);
+			}
+		} else if(visible_dice > 0) {
+			//blend draws the instances in order, OIT doesn't care about order and doesn't write depth
+			bool use_oit = transparency == TRANSPARENCY_OIT;
+			RenderItem dice_state = { PASS_TRANSPARENT, use_oit ? die_oit_shader.id : die_shader.id, skybox_texture, pool.vao, !use_oit, CULL_NONE, 0, 0, 0.0f, 0 };
+			GLuint die_lods[MAX_LODS];
+			pack_instances_by_lod(die_mesh, visible_dice, die_world, lod_view, &instances[die_base + first_die], &instance_lods[first_die], die_lods);
+			first_instance = die_base + first_die;
+			for(int l = 0; l < MAX_LODS; l++) {
+				if(die_lods[l] == 0) continue;
+				const MeshLod &lod = die_mesh.lods[l];
+				list.draw(dice_state, { lod.index_count, die_lods[l], lod.first_index, die_mesh.base_vertex, first_instance });
+				first_instance += die_lods[l];
+			}
+		}
+	};
 
 	bool s_key_pressed = false;
 	bool o_key_pressed = false;
 	bool key1_pressed = false;
 	bool key2_pressed = false;
 	bool key3_pressed = false;
+	bool t_key_pressed = false;
 	bool orbit = false;
 
 	float prev_time = glfwGetTime();
+
+	//Render on demand: only draw when something changed (input, orbit, skybox switch, resize)
+	bool redraw = true;
+	int fb_width, fb_height;
+	int last_fb_width = 0;
+	int last_fb_height = 0;
+	glfwSetWindowRefreshCallback(window, window_refresh_callback);
+	FrameStats stats;
+	stats.start(prev_time);
+
+	//Skybox switch in progress: when it started, frames drawn meanwhile and the longest loop iteration
+	double switch_start = 0.0;
+	double switch_worst_ms = 0.0;
+	long switch_frames = 0;
+	double last_iteration = glfwGetTime();
 	
 	while(!glfwWindowShouldClose(window)) {
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glfwGetWindowSize(window, &win_width, &win_height);
-		glfwGetFramebufferSize(window, &win_width, &win_height);
-		if(win_height == win_width) { //I want to keep the 1:1 aspect ratio
-			glViewport(0, 0, win_height, win_height);
-			projection_info[0].aspect_ratio = aux::get_aspect_ratio(win_height, win_height);
-		} else if (win_width > win_height) {
-			glViewport(0, 0, win_height, win_height);
-			projection_info[0].aspect_ratio = aux::get_aspect_ratio(win_height, win_height);
-		} else {
-			glViewport(0, 0, win_width, win_width);
-			projection_info[0].aspect_ratio = aux::get_aspect_ratio(win_width, win_width);
+		float time = glfwGetTime();
+
+		//SKYBOX STREAMING: a slice of the upload in flight per iteration
+		double iteration_start = glfwGetTime();
+		if(!wanted_skybox.empty()) {
+			if(switch_start == 0.0) {
+				switch_start = iteration_start;
+				switch_worst_ms = 0.0;
+				switch_frames = 0;
+			} else {
+				switch_worst_ms = std::max(switch_worst_ms, (iteration_start - last_iteration) * 1000.0);
+			}
+		}
+		last_iteration = iteration_start;
+		CubemapStream finished;
+		if(skybox_streamer.update(finished)) {
+			if(!finished.ok) {
+				std::cerr << "Failed to load " << finished.dir << ", keeping " << shown_skybox << std::endl;
+				if(finished.dir == wanted_skybox) {
+					wanted_skybox.clear();
+					switch_start = 0.0;
+				}
+			} else {
+				skyboxes.insert(finished.dir, finished.texture, skybox_texture);
+				if(finished.dir == wanted_skybox) {
+					skybox_texture = finished.texture;
+					shown_skybox = finished.dir;
+					wanted_skybox.clear();
+					redraw = true;
+					std::cout << "Switched to " << finished.dir << " after " << (glfwGetTime() - switch_start) * 1000.0
+						<< " ms, " << switch_frames << " frames in between, worst frame " << switch_worst_ms << " ms (";
+					print_skybox_cache(skyboxes);
+					std::cout << ")\n";
+					switch_start = 0.0;
+					if(prefetch_skyboxes) prefetch_next_skybox(skyboxes, skybox_streamer, shown_skybox);
+				}
+			}
 		}
 
-		float time = glfwGetTime();
-				
-		glDepthMask(GL_FALSE);
-		glUseProgram(skybox_shader);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture);
-    	skybox_matrix = projection_matrix * skybox_view_matrix;
-		glUniformMatrix4fv(glGetUniformLocation(skybox_shader, "skybox_matrix"), 1, GL_FALSE, glm::value_ptr(skybox_matrix));
-		glUniformMatrix4fv(glGetUniformLocation(skybox_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(skybox_model_matrix));
-		glBindVertexArray(skybox_vao);
-		glDrawArrays(GL_TRIANGLES, 0, cube_v_total);
-		glDepthMask(GL_TRUE);
-
-		glUseProgram(sphere_shader);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-		sphere_matrix = projection_matrix * sphere_view_matrix;
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "sphere_matrix"), 1, GL_FALSE, glm::value_ptr(sphere_matrix));
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere1_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere21_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere22_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere31_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere32_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere33_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere41_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere42_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere43_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere44_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere51_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere52_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere53_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere54_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere55_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere61_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere62_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere63_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere64_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere65_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere66_model_matrix));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-
-		glUseProgram(die_shader);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture);
-		die_matrix = projection_matrix * die_view_matrix;
-		glUniformMatrix4fv(glGetUniformLocation(die_shader, "camera_position"), 1, GL_FALSE, glm::value_ptr(die_camera_position));
-		glUniformMatrix4fv(glGetUniformLocation(die_shader, "die_matrix"), 1, GL_FALSE, glm::value_ptr(die_matrix));
-		glUniformMatrix4fv(glGetUniformLocation(die_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(model_matrix));
-		glBindVertexArray(die_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, die_i_vbo);
-		glDrawElements(GL_TRIANGLES, die_indices.size(), GL_UNSIGNED_INT, NULL);
-
-		glUseProgram(sphere_shader);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-		sphere_matrix = projection_matrix * sphere_view_matrix;
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "sphere_matrix"), 1, GL_FALSE, glm::value_ptr(sphere_matrix));
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere1_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere21_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere22_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere31_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere32_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere33_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere41_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere42_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere43_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere44_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere51_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere52_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere53_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere54_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere55_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere61_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere62_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere63_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere64_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere65_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-		
-		glUniformMatrix4fv(glGetUniformLocation(sphere_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(sphere66_model_matrix2));
-		glBindVertexArray(sphere_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_i_vbo);
-		glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, NULL);
-
-		glUseProgram(die_shader);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture);
-		die_matrix = projection_matrix * die_view_matrix;
-		glUniformMatrix4fv(glGetUniformLocation(die_shader, "camera_position"), 1, GL_FALSE, glm::value_ptr(die_camera_position));
-		glUniformMatrix4fv(glGetUniformLocation(die_shader, "die_matrix"), 1, GL_FALSE, glm::value_ptr(die_matrix));
-		glUniformMatrix4fv(glGetUniformLocation(die_shader, "model_matrix"), 1, GL_FALSE, glm::value_ptr(model_matrix2));
-		glBindVertexArray(die_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, die_i_vbo);
-		glDrawElements(GL_TRIANGLES, die_indices.size(), GL_UNSIGNED_INT, NULL);
-
-		//AUTO ORBITTING CAMERA
-		if(orbit == true) {
-			float delta_time = float(time - prev_time);
-			glm::quat quaternion = glm::quat(glm::vec3(-1 * aux::degrees_to_radians(delta_time * 3), aux::degrees_to_radians(delta_time * 10), 0));
-			glm::mat4 rot = glm::mat4_cast(quaternion);
+		//minimized: nothing to draw into, the size check below redraws once it is back
+		glfwGetFramebufferSize(window, &win_width, &win_height);
+		bool minimized = win_width == 0 || win_height == 0;
+		if(minimized) redraw = false;
+		if(!minimized && (redraw || orbit || !on_demand)) {
+			stats.begin_frame(glfwGetTime());
+			pool.draw_calls = pool.triangles = 0;
+			std::fill(pool.lod_triangles, pool.lod_triangles + MAX_LODS, 0);
+			queue.state_changes = queue.state_changes_avoided = queue.merged_draws = 0;
+			if(transparency == TRANSPARENCY_OIT && !oit.resize(win_width, win_height)) {
+				std::cout << "No OIT framebuffer, using sorted transparency\n";
+				transparency = TRANSPARENCY_SORTED;
+			}
+			if(transparency == TRANSPARENCY_OIT) {
+				oit.begin_opaque();
+			} else {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			}
+			if(win_height == win_width) { //I want to keep the 1:1 aspect ratio
+				glViewport(0, 0, win_height, win_height);
+				projection_info[0].aspect_ratio = aux::get_aspect_ratio(win_height, win_height);
+			} else if (win_width > win_height) {
+				glViewport(0, 0, win_height, win_height);
+				projection_info[0].aspect_ratio = aux::get_aspect_ratio(win_height, win_height);
+			} else {
+				glViewport(0, 0, win_width, win_width);
+				projection_info[0].aspect_ratio = aux::get_aspect_ratio(win_width, win_width);
+			}
+			lod_view.view = die_view_matrix;
+			lod_view.pixels_per_unit = std::min(win_width, win_height) / (2.0f * tan(projection_info[0].fov / 2.0f));
 
-			skybox_model_matrix = rot * skybox_model_matrix;
-			
-			model_matrix = rot * model_matrix;
-			sphere1_model_matrix = rot * sphere1_model_matrix;
-			sphere21_model_matrix = rot * sphere21_model_matrix;
-			sphere22_model_matrix = rot * sphere22_model_matrix;
-			sphere31_model_matrix = rot * sphere31_model_matrix;
-			sphere32_model_matrix = rot * sphere32_model_matrix;
-			sphere33_model_matrix = rot * sphere33_model_matrix;
-			sphere41_model_matrix = rot * sphere41_model_matrix;
-			sphere42_model_matrix = rot * sphere42_model_matrix;
-			sphere43_model_matrix = rot * sphere43_model_matrix;
-			sphere44_model_matrix = rot * sphere44_model_matrix;
-			sphere51_model_matrix = rot * sphere51_model_matrix;
-			sphere52_model_matrix = rot * sphere52_model_matrix;
-			sphere53_model_matrix = rot * sphere53_model_matrix;
-			sphere54_model_matrix = rot * sphere54_model_matrix;
-			sphere55_model_matrix = rot * sphere55_model_matrix;
-			sphere61_model_matrix = rot * sphere61_model_matrix;
-			sphere62_model_matrix = rot * sphere62_model_matrix;
-			sphere63_model_matrix = rot * sphere63_model_matrix;
-			sphere64_model_matrix = rot * sphere64_model_matrix;
-			sphere65_model_matrix = rot * sphere65_model_matrix;
-			sphere66_model_matrix = rot * sphere66_model_matrix;
-			
-			model_matrix2 = rot * model_matrix2;
-			sphere1_model_matrix2 = rot * sphere1_model_matrix2;
-			sphere21_model_matrix2 = rot * sphere21_model_matrix2;
-			sphere22_model_matrix2 = rot * sphere22_model_matrix2;
-			sphere31_model_matrix2 = rot * sphere31_model_matrix2;
-			sphere32_model_matrix2 = rot * sphere32_model_matrix2;
-			sphere33_model_matrix2 = rot * sphere33_model_matrix2;
-			sphere41_model_matrix2 = rot * sphere41_model_matrix2;
-			sphere42_model_matrix2 = rot * sphere42_model_matrix2;
-			sphere43_model_matrix2 = rot * sphere43_model_matrix2;
-			sphere44_model_matrix2 = rot * sphere44_model_matrix2;
-			sphere51_model_matrix2 = rot * sphere51_model_matrix2;
-			sphere52_model_matrix2 = rot * sphere52_model_matrix2;
-			sphere53_model_matrix2 = rot * sphere53_model_matrix2;
-			sphere54_model_matrix2 = rot * sphere54_model_matrix2;
-			sphere55_model_matrix2 = rot * sphere55_model_matrix2;
-			sphere61_model_matrix2 = rot * sphere61_model_matrix2;
-			sphere62_model_matrix2 = rot * sphere62_model_matrix2;
-			sphere63_model_matrix2 = rot * sphere63_model_matrix2;
-			sphere64_model_matrix2 = rot * sphere64_model_matrix2;
-			sphere65_model_matrix2 = rot * sphere65_model_matrix2;
-			sphere66_model_matrix2 = rot * sphere66_model_matrix2;
-		}
-
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+			scene_changed = scene.begin_update();
+			if(scene_changed) {
+				scene.update_range(0, die_nodes[0]); //root and skybox, the chunks do the rest
+			}
+			refresh_bounds = bounds_stale || scene_changed;
+
+			camera.projection_matrix = projection_matrix;
+			upload_camera(camera_ring, camera);
+
+			//instance matrices are written straight into this frame's slice of the ring
+			pool.begin_frame();
+			instances = pool.instances();
+			frustum = extract_frustum(projection_matrix * die_view_matrix);
+			jobs.run(chunk_count, record_chunk);
+			if(scene_changed) {
+				scene.end_update();
+			}
+			bounds_stale = false;
+			instances[skybox_node - 1] = scene.world(skybox_node);
+			pool.instances_written(0, scene.size() - 1);
+
+			//RENDER QUEUE: skybox, then every chunk's pips and glass dice
+			queue.clear();
+			pool.clear_frame_commands();
+			RenderItem skybox_item = { PASS_BACKGROUND, skybox_shader.id, skybox_texture, pool.vao, false, CULL_NONE, SKYBOX_COMMAND, 1, 0.0f, 0 };
+			queue.add(skybox_item, projection_info[0].far);
+			for(int c = 0; c < chunk_count; c++) {
+				replay(chunk_lists[c], pool, queue, projection_info[0].far);
+			}
+			queue.sort();
+
+			queue.submit(pool, PASS_BACKGROUND, PASS_OPAQUE);
+			if(transparency == TRANSPARENCY_OIT) {
+				oit.begin_transparent();
+				queue.submit(pool, PASS_TRANSPARENT, PASS_TRANSPARENT);
+				oit.resolve();
+			} else {
+				queue.submit(pool, PASS_TRANSPARENT, PASS_TRANSPARENT);
+			}
+			pool.end_frame();
+			camera_ring.end_frame();
+
+			//AUTO ORBITTING CAMERA
+			if(orbit == true) {
+				float delta_time = float(time - prev_time);
+				glm::quat quaternion = glm::quat(glm::vec3(-1 * aux::degrees_to_radians(delta_time * 3), aux::degrees_to_radians(delta_time * 10), 0));
+				glm::mat4 rot = glm::mat4_cast(quaternion);
+
+				scene.transform(root_node, rot);
+			}
+
+			stats.end_frame(glfwGetTime(), pool.draw_calls, pool.triangles, queue.state_changes, queue.state_changes_avoided, pool.lod_triangles);
+			stats.ring_stalls = pool.instance_ring.stalls + camera_ring.stalls;
+			if(max_frames > 0 && stats.frames_rendered >= max_frames) {
+				if(headless) {
+					captureScene(screenshot_number, win_width, win_height);
+				}
+				glfwSetWindowShouldClose(window, GLFW_TRUE);
+			}
+			glfwSwapBuffers(window);
+			redraw = false;
+			if(switch_start != 0.0) switch_frames++;
+		}
+
+		//Nothing moves until the next event, sleep instead of spinning. Held keys are polled so they keep animating,
+		//and a skybox being uploaded keeps the loop going. One still being decoded doesn't, the decoder wakes the loop when it is done
+		if(minimized || (on_demand && !redraw && !orbit && !continuous_key_held(window) && !skybox_streamer.has_gl_work())) {
+			glfwWaitEventsTimeout(IDLE_WAIT_TIMEOUT);
+			time = glfwGetTime();
+			prev_time = time; //don't turn the time spent asleep into one big rotation
+		} else {
+			glfwPollEvents();
+		}
+		if(window_damaged) {
+			window_damaged = false;
+			redraw = true;
+		}
+		glfwGetFramebufferSize(window, &fb_width, &fb_height);
+		if(fb_width != last_fb_width || fb_height != last_fb_height) {
+			last_fb_width = fb_width;
+			last_fb_height = fb_height;
+			redraw = true;
+		}
+		if(print_stats) {
+			stats.report(time);
+		}
 		
 		//TAKE SCREENSHOT
 		if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS && s_key_pressed == false) { //WOW glfw callbacks are awful, even lambda cant fix them
@@ -906,6 +1483,7 @@ int main() {
 			o_key_pressed = true;
 			if (orbit == false) orbit = true;
 			else orbit = false;
+			redraw = true;
 		}
 		if (glfwGetKey(window, GLFW_KEY_O) == GLFW_RELEASE && o_key_pressed == true) {
 			o_key_pressed = false;
@@ -914,12 +1492,9 @@ int main() {
 		//CHANGE SKYBOX
 		if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS && key1_pressed == false) {
 			key1_pressed = true;
-			skybox_texture = load_cube_tex("skybox/", 0);
-			if(skybox_texture == -1) {
-				std::cerr << "Failed to load textures. Exiting.\n";
-				return 1;
-			}
-			std::cout << "Loaded SkyBox Texture\n";
+			switch_skybox(skyboxes, skybox_streamer, "skybox/", skybox_texture, shown_skybox, wanted_skybox);
+			if(prefetch_skyboxes && wanted_skybox.empty()) prefetch_next_skybox(skyboxes, skybox_streamer, shown_skybox);
+			redraw = true;
 		}
 		if (glfwGetKey(window, GLFW_KEY_1) == GLFW_RELEASE && key1_pressed == true) {
 			key1_pressed = false;
@@ -927,12 +1502,9 @@ int main() {
 
 		if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS && key2_pressed == false) {
 			key2_pressed = true;
-			skybox_texture = load_cube_tex("skybox2/", 0);
-			if(skybox_texture == -1) {
-				std::cerr << "Failed to load textures. Exiting.\n";
-				return 1;
-			}
-			std::cout << "Loaded SkyBox2 Texture\n";
+			switch_skybox(skyboxes, skybox_streamer, "skybox2/", skybox_texture, shown_skybox, wanted_skybox);
+			if(prefetch_skyboxes && wanted_skybox.empty()) prefetch_next_skybox(skyboxes, skybox_streamer, shown_skybox);
+			redraw = true;
 		}
 		if (glfwGetKey(window, GLFW_KEY_2) == GLFW_RELEASE && key2_pressed == true) {
 			key2_pressed = false;
@@ -940,304 +1512,77 @@ int main() {
 
 		if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS && key3_pressed == false) {
 			key3_pressed = true;
-			skybox_texture = load_cube_tex("skybox3/", 0);
-			if(skybox_texture == -1) {
-				std::cerr << "Failed to load textures. Exiting.\n";
-				return 1;
-			}
-			std::cout << "Loaded SkyBox3 Texture\n";
+			switch_skybox(skyboxes, skybox_streamer, "skybox3/", skybox_texture, shown_skybox, wanted_skybox);
+			if(prefetch_skyboxes && wanted_skybox.empty()) prefetch_next_skybox(skyboxes, skybox_streamer, shown_skybox);
+			redraw = true;
 		}
 		if (glfwGetKey(window, GLFW_KEY_3) == GLFW_RELEASE && key3_pressed == true) {
 			key3_pressed = false;
 		}
 
+		//CYCLE TRANSPARENCY MODE
+		if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS && t_key_pressed == false) {
+			t_key_pressed = true;
+			transparency = (transparency + 1) % 3;
+			if(transparency == TRANSPARENCY_OIT && !oit.supported) transparency = TRANSPARENCY_BLEND;
+			std::cout << "Transparency: " << transparency_names[transparency] << "\n";
+			redraw = true;
+		}
+		if (glfwGetKey(window, GLFW_KEY_T) == GLFW_RELEASE && t_key_pressed == true) {
+			t_key_pressed = false;
+		}
+
 		//ROTATE SCENE
 		if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) { //repeated code better than unreadable code
 			float delta_time = float(time - prev_time);
 			glm::quat quaternion = glm::quat(glm::vec3(0, -1 * aux::degrees_to_radians(delta_time * 30), 0));
 			glm::mat4 rot = glm::mat4_cast(quaternion);
-			skybox_model_matrix = rot * skybox_model_matrix;
-			
-			model_matrix = rot * model_matrix;
-			sphere1_model_matrix = rot * sphere1_model_matrix;
-			sphere21_model_matrix = rot * sphere21_model_matrix;
-			sphere22_model_matrix = rot * sphere22_model_matrix;
-			sphere31_model_matrix = rot * sphere31_model_matrix;
-			sphere32_model_matrix = rot * sphere32_model_matrix;
-			sphere33_model_matrix = rot * sphere33_model_matrix;
-			sphere41_model_matrix = rot * sphere41_model_matrix;
-			sphere42_model_matrix = rot * sphere42_model_matrix;
-			sphere43_model_matrix = rot * sphere43_model_matrix;
-			sphere44_model_matrix = rot * sphere44_model_matrix;
-			sphere51_model_matrix = rot * sphere51_model_matrix;
-			sphere52_model_matrix = rot * sphere52_model_matrix;
-			sphere53_model_matrix = rot * sphere53_model_matrix;
-			sphere54_model_matrix = rot * sphere54_model_matrix;
-			sphere55_model_matrix = rot * sphere55_model_matrix;
-			sphere61_model_matrix = rot * sphere61_model_matrix;
-			sphere62_model_matrix = rot * sphere62_model_matrix;
-			sphere63_model_matrix = rot * sphere63_model_matrix;
-			sphere64_model_matrix = rot * sphere64_model_matrix;
-			sphere65_model_matrix = rot * sphere65_model_matrix;
-			sphere66_model_matrix = rot * sphere66_model_matrix;
-
-			model_matrix2 = rot * model_matrix2;
-			sphere1_model_matrix2 = rot * sphere1_model_matrix2;
-			sphere21_model_matrix2 = rot * sphere21_model_matrix2;
-			sphere22_model_matrix2 = rot * sphere22_model_matrix2;
-			sphere31_model_matrix2 = rot * sphere31_model_matrix2;
-			sphere32_model_matrix2 = rot * sphere32_model_matrix2;
-			sphere33_model_matrix2 = rot * sphere33_model_matrix2;
-			sphere41_model_matrix2 = rot * sphere41_model_matrix2;
-			sphere42_model_matrix2 = rot * sphere42_model_matrix2;
-			sphere43_model_matrix2 = rot * sphere43_model_matrix2;
-			sphere44_model_matrix2 = rot * sphere44_model_matrix2;
-			sphere51_model_matrix2 = rot * sphere51_model_matrix2;
-			sphere52_model_matrix2 = rot * sphere52_model_matrix2;
-			sphere53_model_matrix2 = rot * sphere53_model_matrix2;
-			sphere54_model_matrix2 = rot * sphere54_model_matrix2;
-			sphere55_model_matrix2 = rot * sphere55_model_matrix2;
-			sphere61_model_matrix2 = rot * sphere61_model_matrix2;
-			sphere62_model_matrix2 = rot * sphere62_model_matrix2;
-			sphere63_model_matrix2 = rot * sphere63_model_matrix2;
-			sphere64_model_matrix2 = rot * sphere64_model_matrix2;
-			sphere65_model_matrix2 = rot * sphere65_model_matrix2;
-			sphere66_model_matrix2 = rot * sphere66_model_matrix2;
+			scene.transform(root_node, rot);
+			redraw = true;
 		}
 		if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
 			float delta_time = float(time - prev_time);
 			glm::quat quaternion = glm::quat(glm::vec3(0, aux::degrees_to_radians(delta_time * 30), 0));
 			glm::mat4 rot = glm::mat4_cast(quaternion);
-			skybox_model_matrix = rot * skybox_model_matrix;
-			
-			model_matrix = rot * model_matrix;
-			sphere1_model_matrix = rot * sphere1_model_matrix;
-			sphere21_model_matrix = rot * sphere21_model_matrix;
-			sphere22_model_matrix = rot * sphere22_model_matrix;
-			sphere31_model_matrix = rot * sphere31_model_matrix;
-			sphere32_model_matrix = rot * sphere32_model_matrix;
-			sphere33_model_matrix = rot * sphere33_model_matrix;
-			sphere41_model_matrix = rot * sphere41_model_matrix;
-			sphere42_model_matrix = rot * sphere42_model_matrix;
-			sphere43_model_matrix = rot * sphere43_model_matrix;
-			sphere44_model_matrix = rot * sphere44_model_matrix;
-			sphere51_model_matrix = rot * sphere51_model_matrix;
-			sphere52_model_matrix = rot * sphere52_model_matrix;
-			sphere53_model_matrix = rot * sphere53_model_matrix;
-			sphere54_model_matrix = rot * sphere54_model_matrix;
-			sphere55_model_matrix = rot * sphere55_model_matrix;
-			sphere61_model_matrix = rot * sphere61_model_matrix;
-			sphere62_model_matrix = rot * sphere62_model_matrix;
-			sphere63_model_matrix = rot * sphere63_model_matrix;
-			sphere64_model_matrix = rot * sphere64_model_matrix;
-			sphere65_model_matrix = rot * sphere65_model_matrix;
-			sphere66_model_matrix = rot * sphere66_model_matrix;
-
-			model_matrix2 = rot * model_matrix2;
-			sphere1_model_matrix2 = rot * sphere1_model_matrix2;
-			sphere21_model_matrix2 = rot * sphere21_model_matrix2;
-			sphere22_model_matrix2 = rot * sphere22_model_matrix2;
-			sphere31_model_matrix2 = rot * sphere31_model_matrix2;
-			sphere32_model_matrix2 = rot * sphere32_model_matrix2;
-			sphere33_model_matrix2 = rot * sphere33_model_matrix2;
-			sphere41_model_matrix2 = rot * sphere41_model_matrix2;
-			sphere42_model_matrix2 = rot * sphere42_model_matrix2;
-			sphere43_model_matrix2 = rot * sphere43_model_matrix2;
-			sphere44_model_matrix2 = rot * sphere44_model_matrix2;
-			sphere51_model_matrix2 = rot * sphere51_model_matrix2;
-			sphere52_model_matrix2 = rot * sphere52_model_matrix2;
-			sphere53_model_matrix2 = rot * sphere53_model_matrix2;
-			sphere54_model_matrix2 = rot * sphere54_model_matrix2;
-			sphere55_model_matrix2 = rot * sphere55_model_matrix2;
-			sphere61_model_matrix2 = rot * sphere61_model_matrix2;
-			sphere62_model_matrix2 = rot * sphere62_model_matrix2;
-			sphere63_model_matrix2 = rot * sphere63_model_matrix2;
-			sphere64_model_matrix2 = rot * sphere64_model_matrix2;
-			sphere65_model_matrix2 = rot * sphere65_model_matrix2;
-			sphere66_model_matrix2 = rot * sphere66_model_matrix2;
+			scene.transform(root_node, rot);
+			redraw = true;
 		}
 		if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
 			float delta_time = float(time - prev_time);
 			glm::quat quaternion = glm::quat(glm::vec3(aux::degrees_to_radians(delta_time * 30), 0, 0));
 			glm::mat4 rot = glm::mat4_cast(quaternion);
-			skybox_model_matrix = rot * skybox_model_matrix;
-			
-			model_matrix = rot * model_matrix;
-			sphere1_model_matrix = rot * sphere1_model_matrix;
-			sphere21_model_matrix = rot * sphere21_model_matrix;
-			sphere22_model_matrix = rot * sphere22_model_matrix;
-			sphere31_model_matrix = rot * sphere31_model_matrix;
-			sphere32_model_matrix = rot * sphere32_model_matrix;
-			sphere33_model_matrix = rot * sphere33_model_matrix;
-			sphere41_model_matrix = rot * sphere41_model_matrix;
-			sphere42_model_matrix = rot * sphere42_model_matrix;
-			sphere43_model_matrix = rot * sphere43_model_matrix;
-			sphere44_model_matrix = rot * sphere44_model_matrix;
-			sphere51_model_matrix = rot * sphere51_model_matrix;
-			sphere52_model_matrix = rot * sphere52_model_matrix;
-			sphere53_model_matrix = rot * sphere53_model_matrix;
-			sphere54_model_matrix = rot * sphere54_model_matrix;
-			sphere55_model_matrix = rot * sphere55_model_matrix;
-			sphere61_model_matrix = rot * sphere61_model_matrix;
-			sphere62_model_matrix = rot * sphere62_model_matrix;
-			sphere63_model_matrix = rot * sphere63_model_matrix;
-			sphere64_model_matrix = rot * sphere64_model_matrix;
-			sphere65_model_matrix = rot * sphere65_model_matrix;
-			sphere66_model_matrix = rot * sphere66_model_matrix;
-
-			model_matrix2 = rot * model_matrix2;
-			sphere1_model_matrix2 = rot * sphere1_model_matrix2;
-			sphere21_model_matrix2 = rot * sphere21_model_matrix2;
-			sphere22_model_matrix2 = rot * sphere22_model_matrix2;
-			sphere31_model_matrix2 = rot * sphere31_model_matrix2;
-			sphere32_model_matrix2 = rot * sphere32_model_matrix2;
-			sphere33_model_matrix2 = rot * sphere33_model_matrix2;
-			sphere41_model_matrix2 = rot * sphere41_model_matrix2;
-			sphere42_model_matrix2 = rot * sphere42_model_matrix2;
-			sphere43_model_matrix2 = rot * sphere43_model_matrix2;
-			sphere44_model_matrix2 = rot * sphere44_model_matrix2;
-			sphere51_model_matrix2 = rot * sphere51_model_matrix2;
-			sphere52_model_matrix2 = rot * sphere52_model_matrix2;
-			sphere53_model_matrix2 = rot * sphere53_model_matrix2;
-			sphere54_model_matrix2 = rot * sphere54_model_matrix2;
-			sphere55_model_matrix2 = rot * sphere55_model_matrix2;
-			sphere61_model_matrix2 = rot * sphere61_model_matrix2;
-			sphere62_model_matrix2 = rot * sphere62_model_matrix2;
-			sphere63_model_matrix2 = rot * sphere63_model_matrix2;
-			sphere64_model_matrix2 = rot * sphere64_model_matrix2;
-			sphere65_model_matrix2 = rot * sphere65_model_matrix2;
-			sphere66_model_matrix2 = rot * sphere66_model_matrix2;
+			scene.transform(root_node, rot);
+			redraw = true;
 		}
 		if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
 			float delta_time = float(time - prev_time);
 			glm::quat quaternion = glm::quat(glm::vec3(-1 * aux::degrees_to_radians(delta_time * 30), 0, 0));
 			glm::mat4 rot = glm::mat4_cast(quaternion);
-			skybox_model_matrix = rot * skybox_model_matrix;
-			
-			model_matrix = rot * model_matrix;
-			sphere1_model_matrix = rot * sphere1_model_matrix;
-			sphere21_model_matrix = rot * sphere21_model_matrix;
-			sphere22_model_matrix = rot * sphere22_model_matrix;
-			sphere31_model_matrix = rot * sphere31_model_matrix;
-			sphere32_model_matrix = rot * sphere32_model_matrix;
-			sphere33_model_matrix = rot * sphere33_model_matrix;
-			sphere41_model_matrix = rot * sphere41_model_matrix;
-			sphere42_model_matrix = rot * sphere42_model_matrix;
-			sphere43_model_matrix = rot * sphere43_model_matrix;
-			sphere44_model_matrix = rot * sphere44_model_matrix;
-			sphere51_model_matrix = rot * sphere51_model_matrix;
-			sphere52_model_matrix = rot * sphere52_model_matrix;
-			sphere53_model_matrix = rot * sphere53_model_matrix;
-			sphere54_model_matrix = rot * sphere54_model_matrix;
-			sphere55_model_matrix = rot * sphere55_model_matrix;
-			sphere61_model_matrix = rot * sphere61_model_matrix;
-			sphere62_model_matrix = rot * sphere62_model_matrix;
-			sphere63_model_matrix = rot * sphere63_model_matrix;
-			sphere64_model_matrix = rot * sphere64_model_matrix;
-			sphere65_model_matrix = rot * sphere65_model_matrix;
-			sphere66_model_matrix = rot * sphere66_model_matrix;
-			
-			model_matrix2 = rot * model_matrix2;
-			sphere1_model_matrix2 = rot * sphere1_model_matrix2;
-			sphere21_model_matrix2 = rot * sphere21_model_matrix2;
-			sphere22_model_matrix2 = rot * sphere22_model_matrix2;
-			sphere31_model_matrix2 = rot * sphere31_model_matrix2;
-			sphere32_model_matrix2 = rot * sphere32_model_matrix2;
-			sphere33_model_matrix2 = rot * sphere33_model_matrix2;
-			sphere41_model_matrix2 = rot * sphere41_model_matrix2;
-			sphere42_model_matrix2 = rot * sphere42_model_matrix2;
-			sphere43_model_matrix2 = rot * sphere43_model_matrix2;
-			sphere44_model_matrix2 = rot * sphere44_model_matrix2;
-			sphere51_model_matrix2 = rot * sphere51_model_matrix2;
-			sphere52_model_matrix2 = rot * sphere52_model_matrix2;
-			sphere53_model_matrix2 = rot * sphere53_model_matrix2;
-			sphere54_model_matrix2 = rot * sphere54_model_matrix2;
-			sphere55_model_matrix2 = rot * sphere55_model_matrix2;
-			sphere61_model_matrix2 = rot * sphere61_model_matrix2;
-			sphere62_model_matrix2 = rot * sphere62_model_matrix2;
-			sphere63_model_matrix2 = rot * sphere63_model_matrix2;
-			sphere64_model_matrix2 = rot * sphere64_model_matrix2;
-			sphere65_model_matrix2 = rot * sphere65_model_matrix2;
-			sphere66_model_matrix2 = rot * sphere66_model_matrix2;
+			scene.transform(root_node, rot);
+			redraw = true;
 		}
 
 		//RESET SCENE
 		if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) {
-			skybox_model_matrix = aux::mat4_identity;
-
-			model_matrix = glm::translate(aux::mat4_identity, glm::vec3(-0.8f, 0.0f, 0.0f));
-			sphere_model_matrix = glm::translate(aux::mat4_identity, glm::vec3(-0.8f, 0.0f, 0.0f));
-
-			model_matrix2 = glm::translate(aux::mat4_identity, glm::vec3(0.8f, 0.0f, 0.0f));
-			sphere_model_matrix2 = glm::translate(aux::mat4_identity, glm::vec3(0.8f, 0.0f, 0.0f));
-
-			model_matrix = glm::rotate(model_matrix, aux::degrees_to_radians(-15.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-			model_matrix2 = glm::rotate(model_matrix2, aux::degrees_to_radians(14.3f), glm::vec3(0.0f, 0.0f, 1.0f));
-
-			sphere_model_matrix = glm::rotate(sphere_model_matrix, aux::degrees_to_radians(-15.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-			sphere_model_matrix2 = glm::rotate(sphere_model_matrix2, aux::degrees_to_radians(14.3f), glm::vec3(0.0f, 0.0f, 1.0f));
-
-			sphere_model_matrix = glm::scale(sphere_model_matrix, glm::vec3(0.1f, 0.1f, 0.1f));
-			sphere_model_matrix2 = glm::scale(sphere_model_matrix2, glm::vec3(0.1f, 0.1f, 0.1f));
-
-			sphere1_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(0.0f, 0.0f, 6.0f));
-			sphere21_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(6.0f, 3.0f, -3.0f));
-			sphere22_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(6.0f, -3.0f, 3.0f));
-			sphere31_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(3.0f, 6.0f, -3.0f));
-			sphere32_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(0.0f, 6.0f, 0.0f));
-			sphere33_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-3.0f, 6.0f, 3.0f));
-			sphere41_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-3.0f, -6.0f, 3.0f));
-			sphere42_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(3.0f, -6.0f, -3.0f));
-			sphere43_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-3.0f, -6.0f, -3.0f));
-			sphere44_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(3.0f, -6.0f, 3.0f));
-			sphere51_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-6.0f, -3.0f, 3.0f));
-			sphere52_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-6.0f, -3.0f, -3.0f));
-			sphere53_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-6.0f, 3.0f, 3.0f));
-			sphere54_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-6.0f, 3.0f, -3.0f));
-			sphere55_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-6.0f, 0.0f, 0.0f));
-			sphere61_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-3.0f, -3.0f, -6.0f));
-			sphere62_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-3.0f, 0.0f, -6.0f));
-			sphere63_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(-3.0f, 3.0f, -6.0f));
-			sphere64_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(3.0f, -3.0f, -6.0f));
-			sphere65_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(3.0f, 0.0f, -6.0f));
-			sphere66_model_matrix = glm::translate(sphere_model_matrix, glm::vec3(3.0f, 3.0f, -6.0f));
-
-			sphere1_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(0.0f, 0.0f, 6.0f));
-			sphere21_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(6.0f, 3.0f, -3.0f));
-			sphere22_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(6.0f, -3.0f, 3.0f));
-			sphere31_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(3.0f, 6.0f, -3.0f));
-			sphere32_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(0.0f, 6.0f, 0.0f));
-			sphere33_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-3.0f, 6.0f, 3.0f));
-			sphere41_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-3.0f, -6.0f, 3.0f));
-			sphere42_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(3.0f, -6.0f, -3.0f));
-			sphere43_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-3.0f, -6.0f, -3.0f));
-			sphere44_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(3.0f, -6.0f, 3.0f));
-			sphere51_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-6.0f, -3.0f, 3.0f));
-			sphere52_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-6.0f, -3.0f, -3.0f));
-			sphere53_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-6.0f, 3.0f, 3.0f));
-			sphere54_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-6.0f, 3.0f, -3.0f));
-			sphere55_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-6.0f, 0.0f, 0.0f));
-			sphere61_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-3.0f, -3.0f, -6.0f));
-			sphere62_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-3.0f, 0.0f, -6.0f));
-			sphere63_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(-3.0f, 3.0f, -6.0f));
-			sphere64_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(3.0f, -3.0f, -6.0f));
-			sphere65_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(3.0f, 0.0f, -6.0f));
-			sphere66_model_matrix2 = glm::translate(sphere_model_matrix2, glm::vec3(3.0f, 3.0f, -6.0f));
+			scene.set_local(root_node, aux::mat4_identity);
 			
 			projection_info[0].fov = aux::degrees_to_radians(45.0f);
 			projection_matrix = glm::perspective(projection_info[0].fov, projection_info[0].aspect_ratio, projection_info[0].near, projection_info[0].far);
 
 			orbit = false;
+			redraw = true;
 		}
 
 		//ZOOM IN AND OUT ZOOMZOOM
 		if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS && projection_info[0].fov < 2.5) {
 			projection_info[0].fov += aux::degrees_to_radians(1.0f);
 			projection_matrix = glm::perspective(projection_info[0].fov, projection_info[0].aspect_ratio, projection_info[0].near, projection_info[0].far);
+			redraw = true;
 		}
 		else if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS && projection_info[0].fov > 0.1) {
 			projection_info[0].fov -= aux::degrees_to_radians(1.0f);
 			projection_matrix = glm::perspective(projection_info[0].fov, projection_info[0].aspect_ratio, projection_info[0].near, projection_info[0].far);
+			redraw = true;
 		}
 
 		prev_time = time;
@@ -1245,46 +1590,21 @@ int main() {
 	
 	//CLEAN-UP ON AISLE 4
 
-	//CLEAR DIE BUFFERS
-	glBindVertexArray(die_vao);
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
-	glDisableVertexAttribArray(2);
-	glDisableVertexAttribArray(4);
-	glDeleteVertexArrays(1, &die_vao);
-
-	glDeleteBuffers(1, &die_vertex_vbo);
-    glDeleteBuffers(1, &die_color_vbo);
-    glDeleteBuffers(1, &die_normals_vbo);
-    glDeleteBuffers(1, &die_i_vbo);
-
-	//CLEAR SKYBOX BUFFERS
-	glBindVertexArray(skybox_vao);
-	glDisableVertexAttribArray(0);
-	glDeleteVertexArrays(1, &skybox_vao);
-	
-	glDeleteBuffers(1, &skybox_vbo);
-
-	//CLEAR SPHERE BUFFERS
-	glBindVertexArray(sphere_vao);
-	glDisableVertexAttribArray(0);
-	glDeleteVertexArrays(1, &sphere_vao);
+	//CLEAR MESH POOL
+	pool.destroy();
 
-	glDeleteBuffers(1, &sphere_vertex_vbo);
-	glDeleteBuffers(1, &sphere_color_vbo);
-	glDeleteBuffers(1, &sphere_i_vbo);
+	camera_ring.destroy();
+	jobs.stop();
+	stats.destroy();
+	oit.destroy();
+	skybox_streamer.destroy();
+	skyboxes.destroy();
 
 	//DELETE SHADERS
-	glDeleteShader(die_vs);
-	glDeleteShader(die_fs);
-	glDeleteShader(skybox_vs);
-	glDeleteShader(skybox_fs);
-	glDeleteShader(sphere_vs);
-	glDeleteShader(sphere_fs);
-
-	glDeleteProgram(die_shader);
-	glDeleteProgram(skybox_shader);
-	glDeleteProgram(sphere_shader);
+	die_shader.destroy();
+	skybox_shader.destroy();
+	sphere_shader.destroy();
+	die_oit_shader.destroy();
 	
 	glfwDestroyWindow(window);
 	glfwTerminate();
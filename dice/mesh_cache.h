@@ -0,0 +1,284 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <string>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "mesh_pool.h"
+#include "obj_loader.h"
+#include "mesh_optimize.h"
+#include "mesh_lod.h"
+#include "arena.h"
+
+//Binary copy of a parsed and optimized (mesh_optimize.h) OBJ and its LOD chain (mesh_lod.h) next to its source
+//(die.obj -> die.obj.unorm16.meshcache), one per vertex format.
+//Layout: MeshCacheHeader, vertex_count * stride bytes of vertices already packed like MeshPool packs them,
+//index_count 32 bit indices (every LOD), submesh_count Submesh (LOD 0's, by material), material_count MeshCacheMaterial.
+//The cache is rebuilt when the version or format don't match, or the source's size does not, or its modification time
+//does not and neither does its hash (the source is only hashed when it was touched). Index ranges and the indices themselves are checked too.
+const uint32_t MESH_CACHE_VERSION = 8;
+
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t vertex_format;
+    uint32_t stride;
+    uint64_t source_size;
+    uint64_t source_mtime; //nanoseconds
+    uint64_t source_hash;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t submesh_count;
+    uint32_t material_count;
+    float bounds_min[3];
+    float bounds_max[3];
+    MeshOptimizeStats optimize_stats;
+    uint32_t lod_count;
+    MeshLod lods[MAX_LODS];
+};
+
+//A usemtl name, the .mtl files aren't read
+struct MeshCacheMaterial
+{
+    char name[64]; //longer names are cut
+};
+
+//FNV-1a, 64 bit
+inline uint64_t hash_bytes(const unsigned char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for(size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+//Size and modification time (nanoseconds) of a file, false when it can't be read
+inline bool file_stamp(const std::string &file, uint64_t &size, uint64_t &mtime)
+{
+    struct stat info;
+    if(stat(file.c_str(), &info) != 0) return false;
+    size = info.st_size;
+    mtime = (uint64_t)info.st_mtim.tv_sec * 1000000000ull + info.st_mtim.tv_nsec;
+    return true;
+}
+
+inline bool hash_file(const std::string &file, uint64_t &hash)
+{
+    MappedFile source;
+    if(!source.open(file)) return false;
+    hash = hash_bytes(source.data, source.size);
+    source.close();
+    return true;
+}
+
+inline std::string mesh_cache_path(const std::string &file, VertexFormat format)
+{
+    const char* names[3] = { "float", "half", "unorm16" };
+    return file + "." + names[format] + ".meshcache";
+}
+
+//A mesh read by read_mesh and not yet in a pool. From the cache the arrays point into the still mapped
+//cache file, after a parse they point into model and packed, which live in arena. add_mesh_data with borrow
+//leaves the vertices where they are, then it may only be released after MeshPool::upload
+struct MeshData
+{
+    bool from_cache = false;
+    MeshOptimizeStats stats; //the optimization's either way
+    const unsigned char* vertices = NULL;
+    GLuint vertex_count = 0;
+    const GLuint* indices = NULL;
+    GLuint index_count = 0;
+    const Submesh* submeshes = NULL;
+    GLuint submesh_count = 0;
+    std::vector<std::string> material_names;
+    MeshLod lods[MAX_LODS];
+    GLuint lod_count = 0;
+    glm::vec3 bounds_min, bounds_max;
+
+    MappedFile cache;
+    LoadArena arena;
+    ObjModel model;
+    std::pmr::vector<unsigned char> packed;
+
+    MeshData() : model(arena.resource()), packed(arena.resource()) {}
+
+    //once it is in the pool nothing of it is needed on the CPU
+    void release()
+    {
+        cache.close();
+        model.free();
+        packed = std::pmr::vector<unsigned char>(arena.resource());
+        vertices = NULL;
+        indices = NULL;
+        submeshes = NULL;
+        material_names = std::vector<std::string>();
+        arena.release();
+    }
+};
+
+//Every count and range in a cache header against the file it came from, so a truncated or corrupt cache is never read past its end,
+//and every index against the vertex count
+inline bool valid_mesh_cache(const MeshCacheHeader &header, const unsigned char* data, size_t size, const MeshPool &pool)
+{
+    if(memcmp(header.magic, "DMSH", 4) != 0 || header.version != MESH_CACHE_VERSION || header.vertex_format != (uint32_t)pool.format
+        || header.stride != (uint32_t)pool.stride() || header.lod_count < 1 || header.lod_count > (uint32_t)MAX_LODS) {
+        return false;
+    }
+    size_t vertex_bytes = (size_t)header.vertex_count * header.stride;
+    size_t index_bytes = (size_t)header.index_count * sizeof(GLuint);
+    if(size != sizeof(header) + vertex_bytes + index_bytes + (size_t)header.submesh_count * sizeof(Submesh) + (size_t)header.material_count * sizeof(MeshCacheMaterial)) {
+        return false;
+    }
+    for(uint32_t i = 0; i < header.lod_count; i++) {
+        const MeshLod &lod = header.lods[i];
+        if(lod.first_index > header.index_count || lod.index_count > header.index_count - lod.first_index) return false;
+    }
+    //one pass over the indices, so a corrupt one never reaches the GPU or the LOD code
+    const GLuint* stored_indices = (const GLuint*)(data + sizeof(header) + vertex_bytes);
+    for(uint32_t i = 0; i < header.index_count; i++) {
+        if(stored_indices[i] >= header.vertex_count) return false;
+    }
+    const unsigned char* stored_submeshes = data + sizeof(header) + vertex_bytes + index_bytes;
+    for(uint32_t i = 0; i < header.submesh_count; i++) {
+        Submesh submesh;
+        memcpy(&submesh, stored_submeshes + i * sizeof(submesh), sizeof(submesh));
+        if(submesh.first_index > header.lods[0].index_count || submesh.index_count > header.lods[0].index_count - submesh.first_index
+            || submesh.material < -1 || submesh.material >= (int)header.material_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Reads the mesh in file packed for pool's vertex format, from its cache when it is valid, otherwise by parsing the OBJ
+//and writing the cache. Doesn't change the pool, so it can run on a job thread (jobs must then be NULL).
+//Returns false when the OBJ can't be read either
+inline bool read_mesh(const std::string &file, const MeshPool &pool, JobSystem* jobs, MeshData &mesh)
+{
+    mesh.from_cache = false;
+    uint64_t source_size = 0;
+    uint64_t source_mtime = 0;
+    uint64_t source_hash = 0;
+    bool hashed = false;
+    file_stamp(file, source_size, source_mtime);
+
+    std::string cache_file = mesh_cache_path(file, pool.format);
+    MappedFile &cache = mesh.cache;
+    if(source_size > 0 && cache.open(cache_file) && cache.size >= sizeof(MeshCacheHeader)) {
+        MeshCacheHeader header;
+        memcpy(&header, cache.data, sizeof(header));
+        bool fresh = valid_mesh_cache(header, cache.data, cache.size, pool) && header.source_size == source_size;
+        if(fresh && header.source_mtime != source_mtime) {
+            //touched, only rebuilt when its contents changed. Otherwise the new time is stored so it isn't hashed again
+            hashed = hash_file(file, source_hash);
+            fresh = hashed && header.source_hash == source_hash;
+            FILE* f = fresh ? fopen(cache_file.c_str(), "r+b") : NULL;
+            if(f != NULL) {
+                fseek(f, offsetof(MeshCacheHeader, source_mtime), SEEK_SET);
+                fwrite(&source_mtime, sizeof(source_mtime), 1, f);
+                fclose(f);
+            }
+        }
+        if(fresh) {
+            mesh.vertices = cache.data + sizeof(header);
+            mesh.vertex_count = header.vertex_count;
+            mesh.indices = (const GLuint*)(mesh.vertices + (size_t)header.vertex_count * header.stride);
+            mesh.index_count = header.index_count;
+            mesh.submeshes = (const Submesh*)(mesh.indices + header.index_count);
+            mesh.submesh_count = header.submesh_count;
+            const unsigned char* stored_materials = (const unsigned char*)(mesh.submeshes + header.submesh_count);
+            mesh.material_names.resize(header.material_count);
+            for(uint32_t i = 0; i < header.material_count; i++) {
+                MeshCacheMaterial stored;
+                memcpy(&stored, stored_materials + i * sizeof(stored), sizeof(stored));
+                stored.name[sizeof(stored.name) - 1] = 0;
+                mesh.material_names[i] = stored.name;
+            }
+            std::copy(header.lods, header.lods + header.lod_count, mesh.lods);
+            mesh.lod_count = header.lod_count;
+            mesh.bounds_min = glm::vec3(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]);
+            mesh.bounds_max = glm::vec3(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]);
+            mesh.stats = header.optimize_stats;
+            mesh.from_cache = true;
+            return true;
+        }
+    }
+    cache.close();
+
+    //only the model and the packed vertices are kept, everything in between is scratch
+    ObjModel &model = mesh.model;
+    std::pmr::memory_resource* scratch = mesh.arena.scratch_resource();
+    if(!load_obj(file, model, jobs, scratch)) {
+        return false;
+    }
+    mesh.stats = optimize_mesh(model, scratch);
+    mesh.lod_count = build_lods(model, mesh.lods, scratch);
+    pool.pack_vertices(model.positions, model.normals, model.texcoords, mesh.packed, mesh.bounds_min, mesh.bounds_max);
+    mesh.vertices = mesh.packed.empty() ? NULL : &mesh.packed[0];
+    mesh.vertex_count = model.positions.size();
+    mesh.indices = model.indices.empty() ? NULL : &model.indices[0];
+    mesh.index_count = model.indices.size();
+    mesh.submeshes = model.submeshes.empty() ? NULL : &model.submeshes[0];
+    mesh.submesh_count = model.submeshes.size();
+    mesh.material_names = model.material_names;
+
+    //written to a temporary file first so a crash never leaves a half written cache behind
+    if(source_size == 0 || (!hashed && !hash_file(file, source_hash))) {
+        return true;
+    }
+    MeshCacheHeader header = {};
+    memcpy(header.magic, "DMSH", 4);
+    header.version = MESH_CACHE_VERSION;
+    header.vertex_format = pool.format;
+    header.stride = pool.stride();
+    header.source_size = source_size;
+    header.source_mtime = source_mtime;
+    header.source_hash = source_hash;
+    header.vertex_count = model.positions.size();
+    header.index_count = model.indices.size();
+    header.submesh_count = model.submeshes.size();
+    header.material_count = model.material_names.size();
+    memcpy(header.bounds_min, &mesh.bounds_min, sizeof(header.bounds_min));
+    memcpy(header.bounds_max, &mesh.bounds_max, sizeof(header.bounds_max));
+    header.optimize_stats = mesh.stats;
+    header.lod_count = mesh.lod_count;
+    std::copy(mesh.lods, mesh.lods + mesh.lod_count, header.lods);
+    std::string temporary = cache_file + ".tmp";
+    FILE* f = fopen(temporary.c_str(), "wb");
+    if(f == NULL) {
+        std::cerr << "Can't write mesh cache " << cache_file << "\n";
+        return true;
+    }
+    std::vector<MeshCacheMaterial> materials(model.material_names.size());
+    for(size_t i = 0; i < materials.size(); i++) {
+        strncpy(materials[i].name, model.material_names[i].c_str(), sizeof(materials[i].name) - 1);
+    }
+    bool written = fwrite(&header, sizeof(header), 1, f) == 1
+        && fwrite(mesh.packed.data(), 1, mesh.packed.size(), f) == mesh.packed.size()
+        && fwrite(model.indices.data(), sizeof(GLuint), model.indices.size(), f) == model.indices.size()
+        && fwrite(model.submeshes.data(), sizeof(Submesh), model.submeshes.size(), f) == model.submeshes.size()
+        && fwrite(materials.data(), sizeof(MeshCacheMaterial), materials.size(), f) == materials.size();
+    written = fclose(f) == 0 && written;
+    if(!written || rename(temporary.c_str(), cache_file.c_str()) != 0) {
+        std::cerr << "Can't write mesh cache " << cache_file << "\n";
+        remove(temporary.c_str());
+    }
+    return true;
+}
+
+//Adds a mesh from read_mesh to the pool. Without borrow it is copied and can be released afterwards, with it the
+//vertices are uploaded from where read_mesh left them (the cache mapping), so it has to live until MeshPool::upload
+inline MeshRange add_mesh_data(MeshPool &pool, const MeshData &mesh, bool borrow = false)
+{
+    return pool.add_packed_mesh(mesh.vertices, mesh.vertex_count, mesh.indices, mesh.index_count, mesh.bounds_min, mesh.bounds_max,
+        mesh.lods, mesh.lod_count, mesh.submeshes, mesh.submesh_count, mesh.material_names.empty() ? NULL : &mesh.material_names[0], mesh.material_names.size(), borrow);
+}
@@ -0,0 +1,376 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+#include "glm/glm.hpp"
+#include "mesh_pool.h"
+#include "obj_loader.h"
+#include "mesh_optimize.h"
+
+//Level of detail chain built at load time with quadric error metric edge collapses (Garland & Heckbert).
+//Vertices are only ever collapsed onto other existing vertices, so every level is just another index
+//buffer over the same vertices. Each level aims at half the triangles of the one before.
+//Topology comes from positions alone, so flat shaded meshes (a vertex per face corner) still simplify;
+//a corner that moved takes the vertex at its new position whose normal is closest to its old one.
+//A level's error is how far, in object space, any vertex may be from where it is in the full mesh.
+const float LOD_REDUCTION = 0.5f;
+const size_t LOD_MIN_TRIANGLES = 32;  //levels stop once a submesh would get smaller than this
+const size_t LOD_MIN_LEVELS = 3;      //fewer only when a mesh is under LOD_MIN_TRIANGLES * 4 triangles or stops simplifying, see build_lods
+const double LOD_BORDER_WEIGHT = 10.0;
+
+//Symmetric 4x4 matrix of a sum of squared plane distances, weight is the total area behind it
+struct Quadric
+{
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+    double weight;
+
+    void clear() { a2 = ab = ac = ad = b2 = bc = bd = c2 = cd = d2 = weight = 0.0; }
+
+    void add_plane(const glm::dvec3 &normal, double d, double w)
+    {
+        a2 += w * normal.x * normal.x; ab += w * normal.x * normal.y; ac += w * normal.x * normal.z; ad += w * normal.x * d;
+        b2 += w * normal.y * normal.y; bc += w * normal.y * normal.z; bd += w * normal.y * d;
+        c2 += w * normal.z * normal.z; cd += w * normal.z * d;
+        d2 += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric &other)
+    {
+        a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad; b2 += other.b2; bc += other.bc;
+        bd += other.bd; c2 += other.c2; cd += other.cd; d2 += other.d2; weight += other.weight;
+    }
+
+    double error(const glm::dvec3 &p) const
+    {
+        return a2 * p.x * p.x + 2.0 * ab * p.x * p.y + 2.0 * ac * p.x * p.z + 2.0 * ad * p.x
+            + b2 * p.y * p.y + 2.0 * bc * p.y * p.z + 2.0 * bd * p.y + c2 * p.z * p.z + 2.0 * cd * p.z + d2;
+    }
+};
+
+struct LodCollapse
+{
+    double cost;
+    unsigned int from, to;
+
+    bool operator<(const LodCollapse &other) const { return cost < other.cost; }
+};
+
+const unsigned long long LOD_NO_EDGE = ~0ull; //never an edge key, points are 32 bit
+
+//Open addressing set of the edges between two welded points, with how many triangles use each
+struct LodEdgeTable
+{
+    std::pmr::vector<unsigned long long> keys;
+    std::pmr::vector<int> uses;
+
+    explicit LodEdgeTable(std::pmr::memory_resource* memory) : keys(memory), uses(memory) {}
+
+    void reset(size_t edge_count)
+    {
+        size_t capacity = 16;
+        while(capacity < edge_count * 2) capacity <<= 1;
+        keys.assign(capacity, LOD_NO_EDGE);
+        uses.assign(capacity, 0);
+    }
+
+    //slot of edge a-b, inserted with 0 uses when it wasn't there
+    size_t slot(unsigned int a, unsigned int b)
+    {
+        unsigned long long key = ((unsigned long long)std::min(a, b) << 32) | std::max(a, b);
+        size_t h = (size_t)((key * 0x9e3779b97f4a7c15ull) >> 32) & (keys.size() - 1);
+        for(; keys[h] != key; h = (h + 1) & (keys.size() - 1)) {
+            if(keys[h] == LOD_NO_EDGE) {
+                keys[h] = key;
+                break;
+            }
+        }
+        return h;
+    }
+};
+
+//Simplifies one triangle list (indices into positions/normals) towards target_triangles, every array comes from scratch.
+//displacement is set to the farthest a vertex was moved, in object space
+inline std::pmr::vector<unsigned int> simplify_triangles(const std::pmr::vector<unsigned int> &indices, const std::pmr::vector<glm::vec3> &positions,
+    const std::pmr::vector<glm::vec3> &normals, size_t target_triangles, float &displacement, std::pmr::memory_resource* scratch = std::pmr::get_default_resource())
+{
+    //weld by position (open addressing on the position bits, as deduplicate_vertices): corners keep their vertex,
+    //topology uses the welded id
+    const unsigned int NOT_WELDED = ~0u;
+    size_t capacity = 16;
+    while(capacity < indices.size() * 2) capacity <<= 1;
+    std::pmr::vector<unsigned int> slots(capacity, 0, scratch); //welded point + 1
+    std::pmr::vector<unsigned int> weld(positions.size(), NOT_WELDED, scratch);
+    std::pmr::vector<glm::dvec3> points(scratch);
+    std::pmr::vector<unsigned int> point_vertex(scratch); //a vertex at each welded point
+    for(size_t i = 0; i < indices.size(); i++) {
+        unsigned int v = indices[i];
+        if(weld[v] != NOT_WELDED) continue;
+        size_t h = hash_vec3(positions[v], 0) & (capacity - 1);
+        for(; slots[h] != 0; h = (h + 1) & (capacity - 1)) {
+            if(memcmp(&positions[point_vertex[slots[h] - 1]], &positions[v], sizeof(glm::vec3)) == 0) break;
+        }
+        if(slots[h] == 0) {
+            slots[h] = points.size() + 1;
+            points.push_back(glm::dvec3(positions[v]));
+            point_vertex.push_back(v);
+        }
+        weld[v] = slots[h] - 1;
+    }
+    size_t point_count = points.size();
+    //vertices sharing each welded position, point p's are vertices_at[vertices_at_offset[p], vertices_at_offset[p + 1])
+    std::pmr::vector<unsigned int> vertices_at_offset(point_count + 1, 0, scratch);
+    for(size_t v = 0; v < weld.size(); v++) {
+        if(weld[v] != NOT_WELDED) vertices_at_offset[weld[v] + 1]++;
+    }
+    for(size_t p = 0; p < point_count; p++) vertices_at_offset[p + 1] += vertices_at_offset[p];
+    std::pmr::vector<unsigned int> vertices_at(vertices_at_offset[point_count], scratch);
+    std::pmr::vector<unsigned int> fill(vertices_at_offset.begin(), vertices_at_offset.end() - 1, scratch);
+    for(size_t v = 0; v < weld.size(); v++) {
+        if(weld[v] != NOT_WELDED) vertices_at[fill[weld[v]]++] = v;
+    }
+    std::pmr::vector<unsigned int> corners(indices.size(), scratch); //welded ids of the current triangles
+    std::pmr::vector<unsigned int> corner_vertex(indices, scratch);  //and the vertex each corner started as
+    for(size_t i = 0; i < indices.size(); i++) corners[i] = weld[indices[i]];
+
+    //plane quadrics of the triangles, plus planes through the open edges so borders stay in place
+    std::pmr::vector<Quadric> quadrics(point_count, scratch);
+    for(size_t p = 0; p < point_count; p++) quadrics[p].clear();
+    LodEdgeTable edges(scratch);
+    edges.reset(corners.size());
+    for(size_t t = 0; t < corners.size() / 3; t++) {
+        for(int k = 0; k < 3; k++) {
+            edges.uses[edges.slot(corners[3 * t + k], corners[3 * t + (k + 1) % 3])]++;
+        }
+    }
+    for(size_t t = 0; t < corners.size() / 3; t++) {
+        glm::dvec3 p0 = points[corners[3 * t]], p1 = points[corners[3 * t + 1]], p2 = points[corners[3 * t + 2]];
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        double area = glm::length(normal);
+        if(area == 0.0) continue;
+        normal /= area;
+        for(int k = 0; k < 3; k++) {
+            quadrics[corners[3 * t + k]].add_plane(normal, -glm::dot(normal, p0), area);
+        }
+        for(int k = 0; k < 3; k++) {
+            unsigned int a = corners[3 * t + k], b = corners[3 * t + (k + 1) % 3];
+            if(edges.uses[edges.slot(a, b)] != 1) continue;
+            glm::dvec3 edge = points[b] - points[a];
+            double length = glm::length(edge);
+            if(length == 0.0) continue;
+            glm::dvec3 border_normal = glm::normalize(glm::cross(edge, normal));
+            double d = -glm::dot(border_normal, points[a]);
+            quadrics[a].add_plane(border_normal, d, length * length * LOD_BORDER_WEIGHT);
+            quadrics[b].add_plane(border_normal, d, length * length * LOD_BORDER_WEIGHT);
+        }
+    }
+
+    std::pmr::vector<unsigned int> collapsed_to(point_count, scratch);
+    std::pmr::vector<unsigned int> merged_into(point_count, scratch); //over every pass, followed to where a point ended up
+    for(size_t p = 0; p < point_count; p++) merged_into[p] = p;
+    std::pmr::vector<bool> locked(point_count, scratch);
+    std::pmr::vector<LodCollapse> collapses(scratch);
+    collapses.reserve(corners.size());
+    //triangles around each point, like vertices_at
+    std::pmr::vector<unsigned int> triangles_at_offset(point_count + 1, scratch);
+    std::pmr::vector<unsigned int> triangles_at(corners.size(), scratch);
+    while(corners.size() / 3 > target_triangles) {
+        for(size_t p = 0; p < point_count; p++) {
+            collapsed_to[p] = p;
+            locked[p] = false;
+        }
+        std::fill(triangles_at_offset.begin(), triangles_at_offset.end(), 0);
+        for(size_t i = 0; i < corners.size(); i++) triangles_at_offset[corners[i] + 1]++;
+        for(size_t p = 0; p < point_count; p++) triangles_at_offset[p + 1] += triangles_at_offset[p];
+        fill.assign(triangles_at_offset.begin(), triangles_at_offset.end() - 1);
+        for(size_t i = 0; i < corners.size(); i++) triangles_at[fill[corners[i]]++] = i / 3;
+        collapses.clear();
+        edges.reset(corners.size());
+        for(size_t t = 0; t < corners.size() / 3; t++) {
+            for(int k = 0; k < 3; k++) {
+                unsigned int a = corners[3 * t + k], b = corners[3 * t + (k + 1) % 3];
+                if(edges.uses[edges.slot(a, b)]++ > 0) continue;
+                Quadric sum = quadrics[a];
+                sum.add(quadrics[b]);
+                double to_b = sum.error(points[b]), to_a = sum.error(points[a]);
+                double w = sum.weight > 0.0 ? sum.weight : 1.0;
+                LodCollapse collapse = { std::min(to_a, to_b) / w, to_b <= to_a ? a : b, to_b <= to_a ? b : a };
+                collapses.push_back(collapse);
+            }
+        }
+        std::sort(collapses.begin(), collapses.end());
+
+        //every collapse removes about two triangles, points around one are locked for the rest of the pass
+        size_t to_remove = corners.size() / 3 - target_triangles;
+        size_t removed = 0;
+        for(size_t c = 0; c < collapses.size() && removed < to_remove; c++) {
+            const LodCollapse &collapse = collapses[c];
+            if(locked[collapse.from] || locked[collapse.to]) continue;
+            bool flips = false;
+            for(unsigned int i = triangles_at_offset[collapse.from]; i < triangles_at_offset[collapse.from + 1] && !flips; i++) {
+                unsigned int t = triangles_at[i];
+                glm::dvec3 before[3], after[3];
+                bool removed_triangle = false;
+                for(int k = 0; k < 3; k++) {
+                    before[k] = after[k] = points[corners[3 * t + k]];
+                    if(corners[3 * t + k] == collapse.to) removed_triangle = true;
+                    if(corners[3 * t + k] == collapse.from) after[k] = points[collapse.to];
+                }
+                if(removed_triangle) continue;
+                glm::dvec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::dvec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+                flips = glm::dot(n0, n1) <= 0.2 * glm::length(n0) * glm::length(n1);
+            }
+            if(flips) continue;
+            collapsed_to[collapse.from] = collapse.to;
+            merged_into[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            for(unsigned int i = triangles_at_offset[collapse.from]; i < triangles_at_offset[collapse.from + 1]; i++) {
+                unsigned int t = triangles_at[i];
+                for(int k = 0; k < 3; k++) locked[corners[3 * t + k]] = true;
+            }
+            removed += 2;
+        }
+        if(removed == 0) break;
+
+        size_t kept = 0;
+        for(size_t t = 0; t < corners.size() / 3; t++) {
+            unsigned int a = collapsed_to[corners[3 * t]], b = collapsed_to[corners[3 * t + 1]], c = collapsed_to[corners[3 * t + 2]];
+            if(a == b || b == c || a == c) continue;
+            corners[3 * kept] = a; corners[3 * kept + 1] = b; corners[3 * kept + 2] = c;
+            for(int k = 0; k < 3; k++) corner_vertex[3 * kept + k] = corner_vertex[3 * t + k];
+            kept++;
+        }
+        corners.resize(kept * 3);
+        corner_vertex.resize(kept * 3);
+    }
+    //collapses only move a point onto another one, so how far it went is its distance to the end of its chain
+    double farthest = 0.0;
+    for(size_t p = 0; p < point_count; p++) {
+        unsigned int end = merged_into[p];
+        while(merged_into[end] != end) end = merged_into[end];
+        merged_into[p] = end;
+        farthest = std::max(farthest, glm::length(points[p] - points[end]));
+    }
+    displacement = (float)farthest;
+
+    std::pmr::vector<unsigned int> result(corners.size(), scratch);
+    for(size_t i = 0; i < corners.size(); i++) {
+        unsigned int v = corner_vertex[i];
+        if(weld[v] == corners[i]) {
+            result[i] = v;
+            continue;
+        }
+        unsigned int first = vertices_at_offset[corners[i]], last = vertices_at_offset[corners[i] + 1];
+        result[i] = vertices_at[first];
+        float best = -2.0f;
+        for(unsigned int k = first; k < last && !normals.empty(); k++) {
+            float similarity = glm::dot(normals[v], normals[vertices_at[k]]);
+            if(similarity > best) {
+                best = similarity;
+                result[i] = vertices_at[k];
+            }
+        }
+    }
+    return result;
+}
+
+//Appends the LOD levels after the model's indices, lods[0] is the model as it is. A level holds every submesh's
+//simplified triangles in submesh order and is itself vertex cache optimized.
+//The chain stops early, with fewer than LOD_MIN_LEVELS levels, when no submesh can be halved without going under
+//LOD_MIN_TRIANGLES (cube.obj, 12 triangles, is LOD 0 only) or a level removes less than a tenth of the triangles.
+//Returns how many levels there are, startup prints them for every mesh. The temporaries come from scratch
+inline GLuint build_lods(ObjModel &model, MeshLod lods[MAX_LODS], std::pmr::memory_resource* scratch = std::pmr::get_default_resource())
+{
+    lods[0].first_index = 0;
+    lods[0].index_count = model.indices.size();
+    lods[0].error = 0.0f;
+    GLuint lod_count = 1;
+    std::pmr::vector<std::pmr::vector<unsigned int> > current(scratch);
+    std::pmr::vector<float> displacement(model.submeshes.size(), 0.0f, scratch); //summed over the levels, a bound on the distance to the full mesh
+    current.reserve(model.submeshes.size());
+    for(size_t s = 0; s < model.submeshes.size(); s++) {
+        const Submesh &submesh = model.submeshes[s];
+        current.emplace_back(model.indices.begin() + submesh.first_index, model.indices.begin() + submesh.first_index + submesh.index_count);
+    }
+    //levels are kept aside and appended at the end, so model.indices grows once
+    std::pmr::vector<std::pmr::vector<unsigned int> > levels(scratch);
+    levels.reserve(MAX_LODS);
+    size_t level_indices = 0;
+    while(lod_count < (GLuint)MAX_LODS) {
+        std::pmr::vector<unsigned int> level(scratch);
+        level.reserve(lods[lod_count - 1].index_count);
+        float error = lods[lod_count - 1].error;
+        for(size_t s = 0; s < current.size(); s++) {
+            size_t triangles = current[s].size() / 3;
+            size_t target = (size_t)(triangles * LOD_REDUCTION);
+            if(target >= LOD_MIN_TRIANGLES) {
+                float moved = 0.0f;
+                current[s] = simplify_triangles(current[s], model.positions, model.normals, target, moved, scratch);
+                displacement[s] += moved;
+            }
+            error = std::max(error, displacement[s]);
+            level.insert(level.end(), current[s].begin(), current[s].end());
+        }
+        GLuint previous = lods[lod_count - 1].index_count;
+        if(level.size() > previous * 0.9f) break; //nothing left that simplifies well
+        optimize_vertex_cache(&level[0], level.size(), model.positions.size(), scratch);
+        MeshLod lod = { (GLuint)(model.indices.size() + level_indices), (GLuint)level.size(), error };
+        level_indices += level.size();
+        levels.push_back(std::move(level));
+        lods[lod_count++] = lod;
+    }
+    model.indices.reserve(model.indices.size() + level_indices);
+    for(size_t l = 0; l < levels.size(); l++) {
+        model.indices.insert(model.indices.end(), levels[l].begin(), levels[l].end());
+    }
+    return lod_count;
+}
+
+//What select_lod needs to know about the camera
+struct LodView
+{
+    glm::mat4 view;
+    float pixels_per_unit; //viewport height / (2 tan(fov / 2)): on screen size of one unit at distance 1
+    float max_pixels;      //largest allowed error on screen, 0 = always LOD 0
+};
+
+//Coarsest level whose error, projected at the instance's distance, stays under max_pixels
+inline int select_lod(const MeshRange &mesh, const glm::mat4 &world, const LodView &lod_view)
+{
+    float distance = -(lod_view.view * world[3]).z;
+    if(distance <= 0.0f || lod_view.max_pixels <= 0.0f) return 0;
+    float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+    float pixels_per_error = scale / distance * lod_view.pixels_per_unit;
+    int lod = 0;
+    while(lod + 1 < (int)mesh.lod_count && mesh.lods[lod + 1].error * pixels_per_error <= lod_view.max_pixels) lod++;
+    return lod;
+}
+
+//Writes count instance matrices to out grouped by level, LOD 0 first, and how many went to each level.
+//world_of(k) gives the k-th instance's matrix, lods is scratch space for count levels
+template<typename WorldOf>
+inline void pack_instances_by_lod(const MeshRange &mesh, int count, WorldOf world_of, const LodView &lod_view, glm::mat4* out, unsigned char* lods, GLuint lod_counts[MAX_LODS])
+{
+    GLuint offsets[MAX_LODS];
+    for(int l = 0; l < MAX_LODS; l++) lod_counts[l] = 0;
+    for(int k = 0; k < count; k++) {
+        lods[k] = select_lod(mesh, world_of(k), lod_view);
+        lod_counts[lods[k]]++;
+    }
+    GLuint offset = 0;
+    for(int l = 0; l < MAX_LODS; l++) {
+        offsets[l] = offset;
+        offset += lod_counts[l];
+    }
+    for(int k = 0; k < count; k++) {
+        out[offsets[lods[k]]++] = world_of(k);
+    }
+}
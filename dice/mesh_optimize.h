@@ -0,0 +1,356 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+#include "glm/glm.hpp"
+#include "obj_loader.h"
+
+//Load time mesh optimization, run on a freshly parsed model before it is packed (and cached):
+// 1. vertices with identical position/normal/texcoord are merged
+// 2. each submesh's triangles are reordered for the post transform vertex cache (Forsyth's linear speed algorithm)
+// 3. that order is cut into clusters at cache restarts and the clusters are sorted outside facing first,
+//    so the parts of the mesh drawn first tend to occlude the rest (Sander et al., Tipsify). Only kept when it
+//    costs no cache misses, and it only helps depth tested draws (nothing in OIT mode)
+// 4. vertices are renumbered in first use order so vertex fetch walks the buffer forwards
+//ACMR = cache misses per triangle (0.5 is about the best a closed mesh gets, 3 is no reuse at all),
+//ATVR = cache misses per vertex (1 is ideal). Both use a FIFO cache of VERTEX_CACHE_SIZE entries.
+const int VERTEX_CACHE_SIZE = 16;
+const int FORSYTH_CACHE_SIZE = 32;
+const float OVERDRAW_THRESHOLD = 1.05f; //soft cluster cuts may make the ACMR this much worse
+
+struct MeshOptimizeStats
+{
+    unsigned int vertices_before = 0, vertices_after = 0;
+    float acmr_before = 0.0f, acmr_after = 0.0f;
+    float atvr_before = 0.0f, atvr_after = 0.0f;
+};
+
+//Cache misses of drawing the indices in order, triangle_misses gets how many each triangle had (0 to 3)
+inline size_t simulate_vertex_cache(const unsigned int* indices, size_t index_count, size_t vertex_count, std::pmr::vector<unsigned char>* triangle_misses = NULL,
+    std::pmr::memory_resource* scratch = std::pmr::get_default_resource())
+{
+    std::pmr::vector<size_t> stamp(vertex_count, 0, scratch); //FIFO position + 1 at the time the vertex entered, 0 = never
+    size_t time = VERTEX_CACHE_SIZE + 1;
+    size_t misses = 0;
+    if(triangle_misses != NULL) triangle_misses->assign(index_count / 3, 0);
+    for(size_t i = 0; i < index_count; i++) {
+        unsigned int v = indices[i];
+        if(stamp[v] == 0 || time - stamp[v] > (size_t)VERTEX_CACHE_SIZE) {
+            stamp[v] = time++;
+            misses++;
+            if(triangle_misses != NULL) (*triangle_misses)[i / 3]++;
+        }
+    }
+    return misses;
+}
+
+inline void vertex_cache_stats(const ObjModel &model, float &acmr, float &atvr, std::pmr::memory_resource* scratch = std::pmr::get_default_resource())
+{
+    size_t misses = simulate_vertex_cache(model.indices.data(), model.indices.size(), model.positions.size(), NULL, scratch);
+    acmr = model.indices.empty() ? 0.0f : misses / (model.indices.size() / 3.0f);
+    atvr = model.positions.empty() ? 0.0f : misses / (float)model.positions.size();
+}
+
+//Hash of the bits of a vec3, equal bits = equal hash (like the memcmp the matches are checked with)
+inline size_t hash_vec3(const glm::vec3 &value, size_t hash)
+{
+    uint32_t bits[3];
+    memcpy(bits, &value, sizeof(bits));
+    for(int i = 0; i < 3; i++) {
+        hash = (hash ^ bits[i]) * 0x9e3779b97f4a7c15ull;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+//Merges vertices whose attributes are bit for bit equal. Open addressing on the attributes themselves,
+//the kept vertices are the keys (same table as obj_build_chunk)
+inline void deduplicate_vertices(ObjModel &model, std::pmr::memory_resource* scratch = std::pmr::get_default_resource())
+{
+    bool has_normals = !model.normals.empty();
+    bool has_texcoords = !model.texcoords.empty();
+    size_t capacity = 16;
+    while(capacity < model.positions.size() * 2) capacity <<= 1;
+    std::pmr::vector<unsigned int> slots(capacity, 0, scratch); //kept vertex + 1
+    std::pmr::vector<unsigned int> remap(model.positions.size(), scratch);
+    size_t count = 0;
+    for(size_t v = 0; v < model.positions.size(); v++) {
+        size_t hash = hash_vec3(model.positions[v], 0);
+        if(has_normals) hash = hash_vec3(model.normals[v], hash);
+        if(has_texcoords) hash = hash_vec3(model.texcoords[v], hash);
+        size_t h = hash & (capacity - 1);
+        for(; slots[h] != 0; h = (h + 1) & (capacity - 1)) {
+            unsigned int k = slots[h] - 1;
+            if(memcmp(&model.positions[k], &model.positions[v], sizeof(glm::vec3)) == 0
+                && (!has_normals || memcmp(&model.normals[k], &model.normals[v], sizeof(glm::vec3)) == 0)
+                && (!has_texcoords || memcmp(&model.texcoords[k], &model.texcoords[v], sizeof(glm::vec3)) == 0)) {
+                break;
+            }
+        }
+        if(slots[h] != 0) {
+            remap[v] = slots[h] - 1;
+            continue;
+        }
+        slots[h] = count + 1;
+        remap[v] = count;
+        model.positions[count] = model.positions[v];
+        if(has_normals) model.normals[count] = model.normals[v];
+        if(has_texcoords) model.texcoords[count] = model.texcoords[v];
+        count++;
+    }
+    model.positions.resize(count);
+    if(has_normals) model.normals.resize(count);
+    if(has_texcoords) model.texcoords.resize(count);
+    for(size_t i = 0; i < model.indices.size(); i++) {
+        model.indices[i] = remap[model.indices[i]];
+    }
+}
+
+//Forsyth's vertex score: recently used vertices score high (the last triangle's three a bit less, to avoid
+//strips), and so do vertices with few triangles left, so isolated ones get finished
+inline float forsyth_score(int cache_position, int remaining)
+{
+    if(remaining == 0) return -1.0f;
+    float score = 0.0f;
+    if(cache_position >= 0) {
+        if(cache_position < 3) score = 0.75f;
+        else score = powf(1.0f - (cache_position - 3) / (float)(FORSYTH_CACHE_SIZE - 3), 1.5f);
+    }
+    return score + 2.0f * powf((float)remaining, -0.5f);
+}
+
+//A triangle and its score when none of its vertices are cached, max heap ordered (ties: lowest triangle first)
+struct ForsythCandidate
+{
+    float score;
+    unsigned int triangle;
+
+    bool operator<(const ForsythCandidate &other) const { return score < other.score || (score == other.score && triangle > other.triangle); }
+};
+
+inline float forsyth_uncached_score(const unsigned int* indices, const std::pmr::vector<int> &remaining, unsigned int t)
+{
+    return forsyth_score(-1, remaining[indices[3 * t]]) + forsyth_score(-1, remaining[indices[3 * t + 1]]) + forsyth_score(-1, remaining[indices[3 * t + 2]]);
+}
+
+//Reorders the triangles of indices[0, index_count) in place.
+//When no cached vertex has a triangle left every remaining triangle is scored by valence alone, and the next one comes
+//from a heap of those scores instead of a scan, so meshes made of many islands stay O(n log n). Each triangle has one
+//entry, refreshed when it is popped with an outdated score. Scores only go up, so an outdated one comes out a bit late at worst
+inline void optimize_vertex_cache(unsigned int* indices, size_t index_count, size_t vertex_count, std::pmr::memory_resource* scratch = std::pmr::get_default_resource())
+{
+    size_t triangle_count = index_count / 3;
+    if(triangle_count == 0) return;
+
+    //vertex -> triangles
+    std::pmr::vector<unsigned int> adjacency_offset(vertex_count + 1, 0, scratch);
+    for(size_t i = 0; i < index_count; i++) adjacency_offset[indices[i] + 1]++;
+    for(size_t v = 0; v < vertex_count; v++) adjacency_offset[v + 1] += adjacency_offset[v];
+    std::pmr::vector<unsigned int> adjacency(index_count, scratch);
+    std::pmr::vector<unsigned int> fill(adjacency_offset.begin(), adjacency_offset.end() - 1, scratch);
+    for(size_t i = 0; i < index_count; i++) adjacency[fill[indices[i]]++] = i / 3;
+
+    std::pmr::vector<int> remaining(vertex_count, scratch);
+    std::pmr::vector<int> cache_position(vertex_count, -1, scratch);
+    std::pmr::vector<float> vertex_score(vertex_count, scratch);
+    for(size_t v = 0; v < vertex_count; v++) {
+        remaining[v] = adjacency_offset[v + 1] - adjacency_offset[v];
+        vertex_score[v] = forsyth_score(-1, remaining[v]);
+    }
+    std::pmr::vector<float> triangle_score(triangle_count, scratch);
+    std::pmr::vector<bool> emitted(triangle_count, false, scratch);
+    std::pmr::vector<ForsythCandidate> candidates(triangle_count, scratch);
+    for(size_t t = 0; t < triangle_count; t++) {
+        triangle_score[t] = vertex_score[indices[3 * t]] + vertex_score[indices[3 * t + 1]] + vertex_score[indices[3 * t + 2]];
+        candidates[t].score = triangle_score[t];
+        candidates[t].triangle = t;
+    }
+    std::make_heap(candidates.begin(), candidates.end());
+
+    std::pmr::vector<unsigned int> output(scratch);
+    output.reserve(index_count);
+    std::pmr::vector<unsigned int> cache(scratch), next_cache(scratch);
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    next_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    long best = -1;
+    while(output.size() < triangle_count * 3) {
+        while(best < 0) { //nothing in the cache, best remaining triangle from the heap
+            std::pop_heap(candidates.begin(), candidates.end());
+            ForsythCandidate candidate = candidates.back();
+            candidates.pop_back();
+            if(emitted[candidate.triangle]) continue;
+            float score = forsyth_uncached_score(indices, remaining, candidate.triangle);
+            if(score == candidate.score) {
+                best = candidate.triangle;
+            } else {
+                candidate.score = score;
+                candidates.push_back(candidate);
+                std::push_heap(candidates.begin(), candidates.end());
+            }
+        }
+        emitted[best] = true;
+        next_cache.clear();
+        for(int k = 0; k < 3; k++) {
+            unsigned int v = indices[3 * best + k];
+            output.push_back(v);
+            next_cache.push_back(v);
+            remaining[v]--;
+            //take the triangle out of the vertex's list of remaining ones
+            unsigned int* list = &adjacency[adjacency_offset[v]];
+            for(int a = 0; a <= remaining[v]; a++) {
+                if(list[a] == (unsigned int)best) {
+                    std::swap(list[a], list[remaining[v]]);
+                    break;
+                }
+            }
+        }
+        for(size_t c = 0; c < cache.size(); c++) {
+            if(std::find(next_cache.begin(), next_cache.end(), cache[c]) == next_cache.end()) next_cache.push_back(cache[c]);
+        }
+        for(size_t c = FORSYTH_CACHE_SIZE; c < next_cache.size(); c++) { //fell out of the cache
+            cache_position[next_cache[c]] = -1;
+            vertex_score[next_cache[c]] = forsyth_score(-1, remaining[next_cache[c]]);
+        }
+        if(next_cache.size() > (size_t)FORSYTH_CACHE_SIZE) next_cache.resize(FORSYTH_CACHE_SIZE);
+        cache.swap(next_cache);
+
+        //rescore the cached vertices, then their triangles, and keep the best of those
+        for(size_t c = 0; c < cache.size(); c++) {
+            cache_position[cache[c]] = c;
+            vertex_score[cache[c]] = forsyth_score(c, remaining[cache[c]]);
+        }
+        best = -1;
+        for(size_t c = 0; c < cache.size(); c++) {
+            unsigned int v = cache[c];
+            for(int a = 0; a < remaining[v]; a++) {
+                unsigned int t = adjacency[adjacency_offset[v] + a];
+                triangle_score[t] = vertex_score[indices[3 * t]] + vertex_score[indices[3 * t + 1]] + vertex_score[indices[3 * t + 2]];
+                if(best < 0 || triangle_score[t] > triangle_score[best]) best = t;
+            }
+        }
+    }
+    memcpy(indices, &output[0], output.size() * sizeof(unsigned int));
+}
+
+//Cuts the cache ordered triangles in clusters and sorts those by how much they face away from the mesh center.
+//The sorted order is dropped again when it misses the vertex cache more often than the one it started from
+inline void optimize_overdraw(unsigned int* indices, size_t index_count, const std::pmr::vector<glm::vec3> &positions, std::pmr::memory_resource* scratch = std::pmr::get_default_resource())
+{
+    size_t triangle_count = index_count / 3;
+    if(triangle_count < 2) return;
+    std::pmr::vector<unsigned char> triangle_misses(scratch);
+    size_t total_misses = simulate_vertex_cache(indices, index_count, positions.size(), &triangle_misses, scratch);
+    float mesh_acmr = total_misses / (float)triangle_count;
+
+    //hard cuts where the cache starts over (a triangle with 3 misses). Soft ones where the cluster so far is about as
+    //cache friendly as the whole mesh, only at triangles that miss twice anyway so the cut costs little reuse
+    std::pmr::vector<size_t> cluster_starts(scratch);
+    size_t cluster_start = 0;
+    size_t cluster_misses = 0;
+    for(size_t t = 0; t < triangle_count; t++) {
+        bool cut = t == 0 || triangle_misses[t] == 3;
+        if(!cut && t - cluster_start >= 8 && cluster_misses / (float)(t - cluster_start) <= mesh_acmr * OVERDRAW_THRESHOLD && triangle_misses[t] >= 2) {
+            cut = true;
+        }
+        if(cut) {
+            cluster_starts.push_back(t);
+            cluster_start = t;
+            cluster_misses = 0;
+        }
+        cluster_misses += triangle_misses[t];
+    }
+    cluster_starts.push_back(triangle_count);
+
+    glm::vec3 mesh_center(0.0f);
+    for(size_t i = 0; i < index_count; i++) mesh_center += positions[indices[i]];
+    mesh_center /= (float)index_count;
+
+    struct Cluster
+    {
+        size_t first;
+        size_t count;
+        float facing;
+    };
+    std::pmr::vector<Cluster> clusters(scratch);
+    for(size_t c = 0; c + 1 < cluster_starts.size(); c++) {
+        Cluster cluster = { cluster_starts[c], cluster_starts[c + 1] - cluster_starts[c], 0.0f };
+        glm::vec3 normal(0.0f), center(0.0f);
+        float area = 0.0f;
+        for(size_t t = cluster.first; t < cluster.first + cluster.count; t++) {
+            glm::vec3 a = positions[indices[3 * t]], b = positions[indices[3 * t + 1]], c2 = positions[indices[3 * t + 2]];
+            glm::vec3 n = glm::cross(b - a, c2 - a); //length = 2 * area
+            float triangle_area = glm::length(n);
+            normal += n;
+            center += (a + b + c2) / 3.0f * triangle_area;
+            area += triangle_area;
+        }
+        if(area > 0.0f && glm::length(normal) > 0.0f) {
+            cluster.facing = glm::dot(center / area - mesh_center, glm::normalize(normal));
+        }
+        clusters.push_back(cluster);
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.facing > b.facing; });
+
+    std::pmr::vector<unsigned int> output(scratch);
+    output.reserve(index_count);
+    for(size_t c = 0; c < clusters.size(); c++) {
+        output.insert(output.end(), indices + clusters[c].first * 3, indices + (clusters[c].first + clusters[c].count) * 3);
+    }
+    if(simulate_vertex_cache(&output[0], index_count, positions.size(), NULL, scratch) > total_misses) return;
+    memcpy(indices, &output[0], index_count * sizeof(unsigned int));
+}
+
+//Renumbers the vertices in the order the indices first use them, unused ones are dropped.
+//The arrays are permuted in place (through a scratch copy), so they are never reallocated
+inline void optimize_vertex_fetch(ObjModel &model, std::pmr::memory_resource* scratch = std::pmr::get_default_resource())
+{
+    std::pmr::vector<int> remap(model.positions.size(), -1, scratch);
+    std::pmr::vector<unsigned int> order(scratch); //new vertex -> old vertex
+    order.reserve(model.positions.size());
+    for(size_t i = 0; i < model.indices.size(); i++) {
+        unsigned int v = model.indices[i];
+        if(remap[v] < 0) {
+            remap[v] = order.size();
+            order.push_back(v);
+        }
+        model.indices[i] = remap[v];
+    }
+    std::pmr::vector<glm::vec3>* arrays[3] = { &model.positions, &model.normals, &model.texcoords };
+    std::pmr::vector<glm::vec3> copy(scratch);
+    for(int a = 0; a < 3; a++) {
+        std::pmr::vector<glm::vec3> &values = *arrays[a];
+        if(values.empty()) continue;
+        copy.assign(values.begin(), values.end());
+        for(size_t v = 0; v < order.size(); v++) {
+            values[v] = copy[order[v]];
+        }
+        values.resize(order.size());
+    }
+}
+
+//Whole pipeline, submesh ranges stay as they are. Every temporary comes from scratch (e.g. LoadArena::scratch_resource)
+inline MeshOptimizeStats optimize_mesh(ObjModel &model, std::pmr::memory_resource* scratch = std::pmr::get_default_resource())
+{
+    MeshOptimizeStats stats;
+    stats.vertices_before = model.positions.size();
+    vertex_cache_stats(model, stats.acmr_before, stats.atvr_before, scratch);
+
+    deduplicate_vertices(model, scratch);
+    for(size_t s = 0; s < model.submeshes.size(); s++) {
+        unsigned int* indices = &model.indices[model.submeshes[s].first_index];
+        optimize_vertex_cache(indices, model.submeshes[s].index_count, model.positions.size(), scratch);
+        optimize_overdraw(indices, model.submeshes[s].index_count, model.positions, scratch);
+    }
+    optimize_vertex_fetch(model, scratch);
+
+    stats.vertices_after = model.positions.size();
+    vertex_cache_stats(model, stats.acmr_after, stats.atvr_after, scratch);
+    return stats;
+}
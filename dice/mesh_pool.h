@@ -0,0 +1,478 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory_resource>
+#include <string>
+#include <algorithm>
+#include <string.h>
+#include <iostream>
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+#include "glm/gtc/packing.hpp"
+#include "ring_buffer.h"
+
+//Interleaved vertex layouts. FLOAT is 32 bytes per vertex (position, normal, texcoord as floats),
+//the packed ones are 16: a 10_10_10_2 snorm normal, half float texcoords and either half float
+//positions or 16 bit unorm positions relative to the mesh bounding box
+enum VertexFormat
+{
+    VERTEX_FLOAT,
+    VERTEX_HALF,
+    VERTEX_UNORM16
+};
+
+//Triangles of a mesh that use the same material (an OBJ usemtl), inside LOD 0. first_index is relative to the mesh
+//while loading, absolute once the mesh is in the pool. material indexes the material names (MeshPool::material_names
+//once in the pool), -1 = none
+struct Submesh
+{
+    GLuint first_index;
+    GLuint index_count;
+    int material;
+};
+
+const int MAX_LODS = 5;
+
+//One level of detail: its own index range over the mesh's vertices. error is how far (object space) the
+//surface may be from the full mesh
+struct MeshLod
+{
+    GLuint first_index;
+    GLuint index_count;
+    float error;
+};
+
+//Where a mesh lives inside the shared vertex/index buffers. Its index range is LOD 0, cut in its submeshes;
+//the other levels follow it in the index buffer
+struct MeshRange
+{
+    GLuint first_index;
+    GLuint index_count;
+    GLint base_vertex;
+    GLuint vertex_count;
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+    GLuint first_submesh; //into MeshPool::submeshes
+    GLuint submesh_count;
+    MeshLod lods[MAX_LODS];
+    GLuint lod_count;
+};
+
+//Per instance dequantization of the position attribute (locations 7 and 8), position = offset + v * scale.
+//Identity unless the pool stores unorm16 positions
+#define DEQUANTIZE_GLSL \
+"layout(location = 7) in vec4 dequant_offset;" \
+"layout(location = 8) in vec4 dequant_scale;"
+
+//Layout fixed by GL for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+//One VAO, one interleaved vertex buffer, one index buffer for every mesh in the scene, plus the per-instance
+//model matrices (locations 3 to 6, streamed through a persistent mapped ring), dequantization (7, 8) and the draw command buffer. Per-draw data is reached through
+//base_instance, so any run of commands that share a program is a single glMultiDrawElementsIndirect.
+//Without GL 4.3 the same commands are replayed one by one.
+class MeshPool
+{
+    public:
+    GLuint vao = 0;
+    GLuint vertex_vbo = 0;
+    GLuint index_vbo = 0;
+    StreamRing instance_ring;
+    GLuint dequant_vbo = 0;
+    GLuint indirect_buffer = 0;
+    GLenum index_type = GL_UNSIGNED_INT;
+    bool multi_draw_indirect = false;
+    bool base_instance = false;
+    //GL draw calls issued and triangles submitted by draw(), the caller resets them
+    long draw_calls = 0;
+    long triangles = 0;
+    long lod_triangles[MAX_LODS] = {};
+    //Of every mesh added, submeshes draw with their mesh's base_vertex
+    std::vector<Submesh> submeshes;
+    std::vector<std::string> material_names;
+
+    //Set before adding meshes, they are packed as they are added
+    VertexFormat format = VERTEX_FLOAT;
+
+    GLsizei stride() const { return format == VERTEX_FLOAT ? 32 : 16; }
+
+    //Missing normals/texcoords are zero filled so all the streams stay the same length
+    MeshRange add_mesh(const std::pmr::vector<glm::vec3> &mesh_positions, const std::pmr::vector<glm::vec3> &mesh_normals, const std::pmr::vector<glm::vec3> &mesh_texcoords, const std::pmr::vector<unsigned int> &mesh_indices)
+    {
+        glm::vec3 bounds_min, bounds_max;
+        std::pmr::vector<unsigned char> packed;
+        pack_vertices(mesh_positions, mesh_normals, mesh_texcoords, packed, bounds_min, bounds_max);
+        return add_packed_mesh(packed.empty() ? NULL : &packed[0], mesh_positions.size(), mesh_indices.empty() ? NULL : &mesh_indices[0], mesh_indices.size(), bounds_min, bounds_max);
+    }
+
+    //Vertices already in this pool's format (see pack_vertices), e.g. straight from a mesh cache mapping.
+    //Submesh and LOD index ranges and material ids are the mesh's own, they are rebased here. Without LODs all the
+    //indices are LOD 0, with them mesh_indices holds every level. Without submeshes LOD 0 is one, with no material.
+    //With borrow_vertices the vertices aren't copied, upload() reads them from mesh_vertices, which has to stay valid until then
+    MeshRange add_packed_mesh(const unsigned char* mesh_vertices, GLuint vertex_count, const GLuint* mesh_indices, GLuint index_count, const glm::vec3 &bounds_min, const glm::vec3 &bounds_max,
+        const MeshLod* mesh_lods = NULL, GLuint lod_count = 0, const Submesh* mesh_submeshes = NULL, GLuint submesh_count = 0,
+        const std::string* mesh_material_names = NULL, GLuint material_count = 0, bool borrow_vertices = false)
+    {
+        MeshRange range;
+        range.first_index = indices.size();
+        range.index_count = lod_count > 0 ? mesh_lods[0].index_count : index_count;
+        range.base_vertex = total_vertices;
+        range.vertex_count = vertex_count;
+        range.bounds_min = bounds_min;
+        range.bounds_max = bounds_max;
+        range.lod_count = lod_count > 0 ? std::min(lod_count, (GLuint)MAX_LODS) : 1;
+        range.lods[0].first_index = 0;
+        range.lods[0].index_count = index_count;
+        range.lods[0].error = 0.0f;
+        for(GLuint i = 0; i < range.lod_count && lod_count > 0; i++) {
+            range.lods[i] = mesh_lods[i];
+        }
+        for(GLuint i = 0; i < range.lod_count; i++) {
+            range.lods[i].first_index += range.first_index;
+        }
+
+        range.first_submesh = submeshes.size();
+        range.submesh_count = submesh_count > 0 ? submesh_count : 1;
+        if(submesh_count == 0) {
+            Submesh whole = { range.first_index, range.index_count, -1 };
+            submeshes.push_back(whole);
+        }
+        for(GLuint i = 0; i < submesh_count; i++) {
+            Submesh submesh = mesh_submeshes[i];
+            submesh.first_index += range.first_index;
+            if(submesh.material >= 0) submesh.material += material_names.size();
+            submeshes.push_back(submesh);
+        }
+        material_names.insert(material_names.end(), mesh_material_names, mesh_material_names + material_count);
+
+        VertexSource source = { borrow_vertices ? mesh_vertices : NULL, vertex_data.size(), (size_t)vertex_count * stride() };
+        if(!borrow_vertices) vertex_data.insert(vertex_data.end(), mesh_vertices, mesh_vertices + source.bytes);
+        vertex_sources.push_back(source);
+        vertex_bytes += source.bytes;
+        indices.insert(indices.end(), mesh_indices, mesh_indices + index_count);
+        total_vertices += vertex_count;
+        meshes.push_back(range);
+        return range;
+    }
+
+    //Interleaves one mesh in the current format. Positions are stored relative to the mesh bounds for unorm16
+    void pack_vertices(const std::pmr::vector<glm::vec3> &mesh_positions, const std::pmr::vector<glm::vec3> &mesh_normals, const std::pmr::vector<glm::vec3> &mesh_texcoords, std::pmr::vector<unsigned char> &packed, glm::vec3 &bounds_min, glm::vec3 &bounds_max) const
+    {
+        MeshRange range;
+        range.bounds_min = range.bounds_max = mesh_positions.empty() ? glm::vec3(0.0f) : mesh_positions[0];
+        for(size_t i = 0; i < mesh_positions.size(); i++) {
+            range.bounds_min = glm::min(range.bounds_min, mesh_positions[i]);
+            range.bounds_max = glm::max(range.bounds_max, mesh_positions[i]);
+        }
+        bounds_min = range.bounds_min;
+        bounds_max = range.bounds_max;
+
+        glm::vec4 offset, scale;
+        dequantization(range, offset, scale);
+        packed.resize(mesh_positions.size() * stride());
+        for(size_t v = 0; v < mesh_positions.size(); v++) {
+            glm::vec3 normal = v < mesh_normals.size() ? mesh_normals[v] : glm::vec3(0.0f);
+            glm::vec3 texcoord = v < mesh_texcoords.size() ? mesh_texcoords[v] : glm::vec3(0.0f);
+            write_vertex(&packed[v * stride()], (mesh_positions[v] - glm::vec3(offset)) / glm::vec3(scale), normal, texcoord);
+        }
+    }
+
+    //Creates the GL objects from everything added so far. The CPU copies are released afterwards
+    void upload(GLsizei max_instances)
+    {
+        multi_draw_indirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+        base_instance = GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+
+        //indices are relative to base_vertex, 16 bits are enough when every mesh has less than 65536 vertices.
+        //A multi draw has a single index type, so one big mesh makes the whole pool 32 bit
+        index_type = GL_UNSIGNED_SHORT;
+        for(size_t i = 0; i < meshes.size(); i++) {
+            if(meshes[i].vertex_count > 65536) index_type = GL_UNSIGNED_INT;
+        }
+
+        GLsizei stride = this->stride();
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+
+        glGenBuffers(1, &vertex_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertex_bytes, NULL, GL_STATIC_DRAW);
+        size_t vertex_offset = 0;
+        for(size_t i = 0; i < vertex_sources.size(); i++) {
+            const VertexSource &source = vertex_sources[i];
+            glBufferSubData(GL_ARRAY_BUFFER, vertex_offset, source.bytes, source.borrowed != NULL ? source.borrowed : &vertex_data[source.offset]);
+            vertex_offset += source.bytes;
+        }
+        for(int i = 0; i < 3; i++) {
+            glEnableVertexAttribArray(i);
+        }
+        if(format == VERTEX_FLOAT) {
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)12);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)24);
+        } else {
+            if(format == VERTEX_HALF) {
+                glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, stride, (void*)0);
+            } else {
+                glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)0);
+            }
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)8);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)12);
+        }
+
+        glGenBuffers(1, &index_vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_vbo);
+        size_t index_size = index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        if(index_type == GL_UNSIGNED_SHORT) {
+            std::vector<GLushort> short_indices(indices.begin(), indices.end());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, short_indices.size() * index_size, &short_indices[0], GL_STATIC_DRAW);
+        } else {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * index_size, &indices[0], GL_STATIC_DRAW);
+        }
+
+        glGenBuffers(1, &dequant_vbo);
+        for(int i = 3; i < 9; i++) {
+            glEnableVertexAttribArray(i);
+            glVertexAttribDivisor(i, 1);
+        }
+        reserve_instances(max_instances);
+        point_instances(0);
+
+        glGenBuffers(1, &indirect_buffer);
+
+        //what the same meshes cost as separate float position/normal/texcoord buffers and 32 bit indices
+        std::cout << "Vertex format: " << format_name() << ", " << stride << " bytes per vertex (36 unpacked), "
+            << vertex_bytes / 1024 << " KB vertices + " << indices.size() * index_size / 1024 << " KB indices uploaded ("
+            << total_vertices * 36 / 1024 << " KB + " << indices.size() * sizeof(GLuint) / 1024 << " KB unpacked)\n";
+
+        vertex_data = std::vector<unsigned char>();
+        vertex_sources = std::vector<VertexSource>();
+        indices = std::vector<GLuint>();
+    }
+
+    //Every frame that draws instances is wrapped in begin_frame/end_frame, the matrices written in between
+    //go to that frame's slice of the instance ring
+    void begin_frame()
+    {
+        instance_ring.begin_frame();
+        glBindVertexArray(vao);
+        point_instances(0);
+    }
+
+    void end_frame()
+    {
+        instance_ring.end_frame();
+    }
+
+    //The current frame's instance matrices, write them directly and report the range with instances_written
+    glm::mat4* instances() { return (glm::mat4*)instance_ring.data(); }
+
+    void instances_written(GLsizei first, GLsizei count)
+    {
+        instance_ring.mark_written((first + count) * sizeof(glm::mat4));
+    }
+
+    void upload_instances(const glm::mat4* matrices, GLsizei count, GLsizei first = 0)
+    {
+        instance_ring.write(first * sizeof(glm::mat4), matrices, count * sizeof(glm::mat4));
+    }
+
+    //Resizes the instance buffers (contents are lost)
+    void reserve_instances(GLsizei max_instances)
+    {
+        if(max_instances <= instance_capacity) return;
+        instance_capacity = max_instances;
+        glFinish(); //the old ring may still be in use
+        instance_ring.destroy();
+        instance_ring.create(GL_ARRAY_BUFFER, max_instances * sizeof(glm::mat4));
+        glBindBuffer(GL_ARRAY_BUFFER, dequant_vbo);
+        glBufferData(GL_ARRAY_BUFFER, max_instances * 2 * sizeof(glm::vec4), NULL, GL_STATIC_DRAW);
+    }
+
+    //Also writes the dequantization of every instance the commands cover, it only changes with the commands
+    void set_commands(const std::vector<DrawElementsIndirectCommand> &new_commands)
+    {
+        commands = new_commands;
+        static_commands = commands.size();
+        std::vector<glm::vec4> dequant(instance_capacity * 2, glm::vec4(0.0f));
+        for(size_t c = 0; c < commands.size(); c++) {
+            const DrawElementsIndirectCommand &cmd = commands[c];
+            glm::vec4 offset(0.0f), scale(1.0f);
+            for(size_t m = 0; m < meshes.size(); m++) {
+                if(meshes[m].first_index <= cmd.first_index && cmd.first_index < meshes[m].first_index + meshes[m].index_count) {
+                    dequantization(meshes[m], offset, scale);
+                }
+            }
+            for(GLuint i = cmd.base_instance; i < cmd.base_instance + cmd.instance_count; i++) {
+                dequant[2 * i] = offset;
+                dequant[2 * i + 1] = scale;
+            }
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, dequant_vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, dequant.size() * sizeof(glm::vec4), &dequant[0]);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), &commands[0], GL_DYNAMIC_DRAW);
+    }
+
+    //Commands that only live for the current frame, appended after the ones from set_commands. They must stay
+    //inside the instance ranges set_commands covered so the dequantization matches. Returns the command index
+    GLuint add_frame_command(const DrawElementsIndirectCommand &command)
+    {
+        commands.push_back(command);
+        commands_dirty = true;
+        return commands.size() - 1;
+    }
+
+    void clear_frame_commands()
+    {
+        if(commands.size() == static_commands) return;
+        commands.resize(static_commands);
+        commands_dirty = true;
+    }
+
+    //Draws commands [first, first + count) with whatever program is bound. bind_vao = false when the caller already bound it
+    void draw(GLuint first, GLsizei count, bool bind_vao = true)
+    {
+        if(bind_vao) glBindVertexArray(vao);
+        instance_ring.flush();
+        if(commands_dirty && multi_draw_indirect) { //orphaned, the previous frame's commands may still be in use
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), &commands[0], GL_STREAM_DRAW);
+        }
+        commands_dirty = false;
+        for(GLuint i = first; i < first + count; i++) {
+            long command_triangles = long(commands[i].count / 3) * commands[i].instance_count;
+            triangles += command_triangles;
+            lod_triangles[lod_of(commands[i].first_index)] += command_triangles;
+        }
+        if(multi_draw_indirect) {
+            draw_calls++;
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, index_type, (void*)(first * sizeof(DrawElementsIndirectCommand)), count, 0);
+            return;
+        }
+        for(GLuint i = first; i < first + count; i++) {
+            const DrawElementsIndirectCommand &cmd = commands[i];
+            void* offset = index_offset(cmd.first_index);
+            draw_calls++;
+            if(base_instance) {
+                glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, cmd.count, index_type, offset, cmd.instance_count, cmd.base_vertex, cmd.base_instance);
+            } else {
+                point_instances(cmd.base_instance);
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, cmd.count, index_type, offset, cmd.instance_count, cmd.base_vertex);
+            }
+        }
+        if(!base_instance) {
+            point_instances(0);
+        }
+    }
+
+    //Byte offset of an index for the non indirect draw calls
+    void* index_offset(GLuint first_index) const
+    {
+        return (void*)(first_index * (index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint)));
+    }
+
+    void destroy()
+    {
+        glBindVertexArray(vao);
+        for(int i = 0; i < 9; i++) {
+            glDisableVertexAttribArray(i);
+        }
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vertex_vbo);
+        glDeleteBuffers(1, &index_vbo);
+        instance_ring.destroy();
+        glDeleteBuffers(1, &dequant_vbo);
+        glDeleteBuffers(1, &indirect_buffer);
+    }
+
+    private:
+    //Where each mesh's vertices are uploaded from: borrowed, or at offset in vertex_data when they were copied
+    struct VertexSource
+    {
+        const unsigned char* borrowed;
+        size_t offset;
+        size_t bytes;
+    };
+    std::vector<unsigned char> vertex_data; //packed, stride() bytes per vertex
+    std::vector<VertexSource> vertex_sources;
+    size_t vertex_bytes = 0;
+    GLuint total_vertices = 0;
+    std::vector<GLuint> indices;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<MeshRange> meshes;
+    GLsizei instance_capacity = 0;
+    bool commands_dirty = false;
+    size_t static_commands = 0;
+
+    //Level a command draws, from where its indices start
+    int lod_of(GLuint first_index) const
+    {
+        for(size_t m = 0; m < meshes.size(); m++) {
+            for(GLuint l = 1; l < meshes[m].lod_count; l++) {
+                if(meshes[m].lods[l].first_index == first_index) return l;
+            }
+        }
+        return 0;
+    }
+
+    const char* format_name() const
+    {
+        return format == VERTEX_FLOAT ? "float" : format == VERTEX_HALF ? "half" : "unorm16";
+    }
+
+    void dequantization(const MeshRange &mesh, glm::vec4 &offset, glm::vec4 &scale) const
+    {
+        offset = glm::vec4(0.0f);
+        scale = glm::vec4(1.0f);
+        if(format == VERTEX_UNORM16) {
+            glm::vec3 extent = mesh.bounds_max - mesh.bounds_min;
+            offset = glm::vec4(mesh.bounds_min, 0.0f);
+            scale = glm::vec4(extent.x > 0.0f ? extent.x : 1.0f, extent.y > 0.0f ? extent.y : 1.0f, extent.z > 0.0f ? extent.z : 1.0f, 0.0f);
+        }
+    }
+
+    void write_vertex(unsigned char* out, const glm::vec3 &position, const glm::vec3 &normal, const glm::vec3 &texcoord) const
+    {
+        if(format == VERTEX_FLOAT) {
+            memcpy(out, &position, 12);
+            memcpy(out + 12, &normal, 12);
+            memcpy(out + 24, &texcoord, 8);
+            return;
+        }
+        glm::uint64 packed_position = format == VERTEX_HALF ? glm::packHalf4x16(glm::vec4(position, 1.0f)) : glm::packUnorm4x16(glm::vec4(position, 1.0f));
+        glm::uint32 packed_normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+        glm::uint32 packed_texcoord = glm::packHalf2x16(glm::vec2(texcoord));
+        memcpy(out, &packed_position, 8);
+        memcpy(out + 8, &packed_normal, 4);
+        memcpy(out + 12, &packed_texcoord, 4);
+    }
+
+    //Points the instance attributes at the current ring slice. Also the GL 3.3 fallback for base_instance:
+    //move the start of the instance attributes instead
+    void point_instances(GLuint first_instance)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instance_ring.buffer);
+        for(int i = 0; i < 4; i++) {
+            glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(instance_ring.offset() + first_instance * sizeof(glm::mat4) + i * sizeof(glm::vec4)));
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, dequant_vbo);
+        for(int i = 0; i < 2; i++) {
+            glVertexAttribPointer(7 + i, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)(first_instance * 2 * sizeof(glm::vec4) + i * sizeof(glm::vec4)));
+        }
+    }
+};
@@ -0,0 +1,445 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory_resource>
+#include <string>
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "glm/glm.hpp"
+#include "jobs.h"
+#include "mesh_pool.h"
+
+//Wavefront OBJ reader for the v/vt/vn/f subset Blender writes. The file is mmapped, numbers are parsed with
+//std::from_chars and faces are fan triangulated. Every distinct v/vt/vn corner becomes one vertex, so the
+//output is indexed and ready for MeshPool::add_mesh. Every object in the file goes into the same model, with
+//its triangles grouped by usemtl into submeshes, so optimizing and simplifying never mix two materials.
+//Nothing draws with material parameters, so the mtllib files aren't read. Everything else (o, g, s, comments) is skipped.
+//Files above OBJ_CHUNK_BYTES are cut in line aligned chunks that are parsed on the job threads.
+const size_t OBJ_CHUNK_BYTES = 1 << 20;
+
+//Everything one OBJ file holds. Submesh index ranges are relative to indices, their material ids index material_names.
+//The geometry arrays come from memory (e.g. a LoadArena), the default is the heap
+struct ObjModel
+{
+    std::pmr::vector<glm::vec3> positions;
+    std::pmr::vector<glm::vec3> normals;   //empty when the file has none
+    std::pmr::vector<glm::vec3> texcoords; //same
+    std::pmr::vector<unsigned int> indices;
+    std::pmr::vector<Submesh> submeshes;
+    std::vector<std::string> material_names; //as in usemtl
+
+    explicit ObjModel(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : positions(memory), normals(memory), texcoords(memory), indices(memory), submeshes(memory) {}
+
+    //empties every array and gives its memory back
+    void free()
+    {
+        std::pmr::memory_resource* memory = positions.get_allocator().resource();
+        positions = std::pmr::vector<glm::vec3>(memory);
+        normals = std::pmr::vector<glm::vec3>(memory);
+        texcoords = std::pmr::vector<glm::vec3>(memory);
+        indices = std::pmr::vector<unsigned int>(memory);
+        submeshes = std::pmr::vector<Submesh>(memory);
+        material_names = std::vector<std::string>();
+    }
+};
+
+//Read only mapping of a whole file
+struct MappedFile
+{
+    const unsigned char* data = NULL;
+    size_t size = 0;
+
+    bool open(const std::string &file)
+    {
+        int fd = ::open(file.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        struct stat info;
+        if(fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        size = info.st_size;
+        void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(mapping == MAP_FAILED) {
+            size = 0;
+            return false;
+        }
+        data = (const unsigned char*)mapping;
+        return true;
+    }
+
+    void close()
+    {
+        if(data != NULL) munmap((void*)data, size);
+        data = NULL;
+        size = 0;
+    }
+};
+
+//A face corner. Positive OBJ indices are global, negative ones are relative to what was read before them,
+//relative is set for those until the chunk's base is known. -1 = not given
+struct ObjCorner
+{
+    int v, vt, vn;
+    unsigned char relative;
+
+    bool operator==(const ObjCorner &other) const { return v == other.v && vt == other.vt && vn == other.vn; }
+};
+
+//The chunk's triangles from first on use one material, named while parsing and with its id after
+struct ObjMaterialRun
+{
+    size_t first;
+    std::string name;
+    int material;
+};
+
+//A line aligned piece of the file and what it parses to, every array comes from memory (load_obj's scratch)
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+    std::pmr::vector<glm::vec3> v, vt, vn;
+    std::pmr::vector<ObjCorner> corners;  //3 per triangle
+    std::pmr::vector<ObjMaterialRun> runs; //its usemtl lines, what is in use at its start comes from the chunks before
+    size_t v_base, vt_base, vn_base;
+    //this chunk's part of the output, vertices deduplicated inside the chunk
+    std::pmr::vector<glm::vec3> positions, normals, texcoords;
+    std::pmr::vector<unsigned int> indices;
+    std::pmr::vector<size_t> material_triangles; //per material id
+    std::pmr::vector<size_t> material_offsets;   //where its triangles of each material go in the model's indices
+    size_t vertex_base;
+
+    explicit ObjChunk(std::pmr::memory_resource* memory)
+        : v(memory), vt(memory), vn(memory), corners(memory), runs(memory), positions(memory), normals(memory), texcoords(memory),
+        indices(memory), material_triangles(memory), material_offsets(memory) {}
+};
+
+inline const char* obj_skip_spaces(const char* p, const char* end)
+{
+    while(p < end && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
+
+inline const char* obj_parse_floats(const char* p, const char* end, float* out, int count)
+{
+    for(int i = 0; i < count; i++) {
+        p = obj_skip_spaces(p, end);
+        out[i] = 0.0f;
+        std::from_chars_result result = std::from_chars(p, end, out[i]);
+        if(result.ec == std::errc()) p = result.ptr;
+    }
+    return p;
+}
+
+inline const char* obj_parse_index(const char* p, const char* end, int &out)
+{
+    out = 0;
+    std::from_chars_result result = std::from_chars(p, end, out);
+    return result.ec == std::errc() ? result.ptr : p;
+}
+
+//Rest of the line without the surrounding whitespace
+inline std::string obj_line_name(const char* p, const char* line_end)
+{
+    p = obj_skip_spaces(p, line_end);
+    while(line_end > p && (line_end[-1] == ' ' || line_end[-1] == '\t' || line_end[-1] == '\r')) line_end--;
+    return std::string(p, line_end);
+}
+
+inline bool obj_keyword(const char* p, const char* line_end, const char* keyword)
+{
+    size_t length = strlen(keyword);
+    return (size_t)(line_end - p) > length && strncmp(p, keyword, length) == 0 && (p[length] == ' ' || p[length] == '\t');
+}
+
+//OBJ index (1 based, or negative from the end) to a 0 based index, chunk relative when negative
+inline int obj_resolve(int index, size_t count, unsigned char &relative, unsigned char bit)
+{
+    if(index > 0) return index - 1;
+    if(index < 0) {
+        relative |= bit;
+        return (int)count + index;
+    }
+    return -1;
+}
+
+//Counts the chunk's v/vt/vn lines and triangle corners first, so parsing fills arrays that never grow
+inline void obj_reserve_chunk(ObjChunk &chunk)
+{
+    size_t v = 0, vt = 0, vn = 0, corners = 0;
+    const char* p = chunk.begin;
+    const char* end = chunk.end;
+    while(p < end) {
+        p = obj_skip_spaces(p, end);
+        const char* line_end = (const char*)memchr(p, '\n', end - p);
+        if(line_end == NULL) line_end = end;
+        if(line_end - p > 2 && p[0] == 'v') {
+            if(p[1] == ' ' || p[1] == '\t') v++;
+            else if(p[1] == 't') vt++;
+            else if(p[1] == 'n') vn++;
+        } else if(line_end - p > 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            size_t tokens = 0;
+            for(const char* q = p + 1; q < line_end; q++) {
+                if((*q == ' ' || *q == '\t') && q + 1 < line_end && q[1] != ' ' && q[1] != '\t' && q[1] != '\r') tokens++;
+            }
+            if(tokens > 2) corners += (tokens - 2) * 3;
+        }
+        p = line_end + 1;
+    }
+    chunk.v.reserve(v);
+    chunk.vt.reserve(vt);
+    chunk.vn.reserve(vn);
+    chunk.corners.reserve(corners);
+}
+
+inline void obj_parse_chunk(ObjChunk &chunk)
+{
+    obj_reserve_chunk(chunk);
+    const char* p = chunk.begin;
+    const char* end = chunk.end;
+    std::pmr::vector<ObjCorner> face(chunk.corners.get_allocator().resource());
+    while(p < end) {
+        p = obj_skip_spaces(p, end);
+        const char* line_end = p;
+        while(line_end < end && *line_end != '\n') line_end++;
+        if(line_end - p > 2 && p[0] == 'v') {
+            float xyz[3];
+            if(p[1] == ' ' || p[1] == '\t') {
+                obj_parse_floats(p + 2, line_end, xyz, 3);
+                chunk.v.push_back(glm::vec3(xyz[0], xyz[1], xyz[2]));
+            } else if(p[1] == 't') {
+                obj_parse_floats(p + 2, line_end, xyz, 3);
+                chunk.vt.push_back(glm::vec3(xyz[0], xyz[1], xyz[2]));
+            } else if(p[1] == 'n') {
+                obj_parse_floats(p + 2, line_end, xyz, 3);
+                chunk.vn.push_back(glm::vec3(xyz[0], xyz[1], xyz[2]));
+            }
+        } else if(line_end - p > 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            face.clear();
+            const char* q = obj_skip_spaces(p + 2, line_end);
+            while(q < line_end && *q != '\r') {
+                int v = 0, vt = 0, vn = 0;
+                q = obj_parse_index(q, line_end, v);
+                if(q < line_end && *q == '/') {
+                    q++;
+                    if(q < line_end && *q != '/') q = obj_parse_index(q, line_end, vt);
+                    if(q < line_end && *q == '/') q = obj_parse_index(q + 1, line_end, vn);
+                }
+                ObjCorner corner;
+                corner.relative = 0;
+                corner.v = obj_resolve(v, chunk.v.size(), corner.relative, 1);
+                corner.vt = obj_resolve(vt, chunk.vt.size(), corner.relative, 2);
+                corner.vn = obj_resolve(vn, chunk.vn.size(), corner.relative, 4);
+                face.push_back(corner);
+                while(q < line_end && *q != ' ' && *q != '\t') q++; //anything unparsed in this token
+                q = obj_skip_spaces(q, line_end);
+            }
+            for(size_t i = 2; i < face.size(); i++) {
+                chunk.corners.push_back(face[0]);
+                chunk.corners.push_back(face[i - 1]);
+                chunk.corners.push_back(face[i]);
+            }
+        } else if(obj_keyword(p, line_end, "usemtl")) {
+            ObjMaterialRun run = { chunk.corners.size() / 3, obj_line_name(p + 6, line_end), -1 };
+            chunk.runs.push_back(run);
+        }
+        p = line_end + 1;
+    }
+}
+
+//Ids in the order the names are first used
+inline int obj_material_id(std::vector<std::string> &names, const std::string &name)
+{
+    for(size_t i = 0; i < names.size(); i++) {
+        if(names[i] == name) return i;
+    }
+    names.push_back(name);
+    return names.size() - 1;
+}
+
+//Attribute with a global index, from the chunk that read it
+inline glm::vec3 obj_lookup(const std::pmr::vector<ObjChunk> &chunks, int index, std::pmr::vector<glm::vec3> ObjChunk::*list, size_t ObjChunk::*base)
+{
+    if(index < 0) return glm::vec3(0.0f);
+    size_t lo = 0, hi = chunks.size();
+    while(hi - lo > 1) { //last chunk whose base is <= index
+        size_t mid = (lo + hi) / 2;
+        if(chunks[mid].*base <= (size_t)index) lo = mid;
+        else hi = mid;
+    }
+    const std::pmr::vector<glm::vec3> &values = chunks[lo].*list;
+    size_t local = index - chunks[lo].*base;
+    return local < values.size() ? values[local] : glm::vec3(0.0f);
+}
+
+inline size_t obj_run_end(const ObjChunk &chunk, size_t run)
+{
+    return run + 1 < chunk.runs.size() ? chunk.runs[run + 1].first : chunk.corners.size() / 3;
+}
+
+//Turns the chunk's corners into deduplicated vertices and counts its triangles per material,
+//needs every chunk's v/vt/vn, the bases and the runs' material ids
+inline void obj_build_chunk(ObjChunk &chunk, const std::pmr::vector<ObjChunk> &chunks, bool has_texcoords, bool has_normals, size_t material_count)
+{
+    std::pmr::memory_resource* scratch = chunk.corners.get_allocator().resource();
+    size_t capacity = 16;
+    while(capacity < chunk.corners.size() * 2) capacity <<= 1;
+    std::pmr::vector<unsigned int> slots(capacity, 0, scratch); //open addressing, vertex index + 1
+    std::pmr::vector<ObjCorner> keys(scratch);
+    keys.reserve(chunk.corners.size());
+    chunk.indices.reserve(chunk.corners.size());
+    for(size_t i = 0; i < chunk.corners.size(); i++) {
+        ObjCorner corner = chunk.corners[i];
+        if(corner.relative & 1) corner.v += chunk.v_base;
+        if(corner.relative & 2) corner.vt += chunk.vt_base;
+        if(corner.relative & 4) corner.vn += chunk.vn_base;
+        corner.relative = 0;
+
+        size_t h = ((size_t)corner.v * 73856093u ^ (size_t)corner.vt * 19349663u ^ (size_t)corner.vn * 83492791u) & (capacity - 1);
+        while(slots[h] != 0 && !(keys[slots[h] - 1] == corner)) h = (h + 1) & (capacity - 1);
+        if(slots[h] == 0) {
+            keys.push_back(corner);
+            slots[h] = keys.size();
+        }
+        chunk.indices.push_back(slots[h] - 1);
+    }
+
+    chunk.positions.resize(keys.size());
+    if(has_texcoords) chunk.texcoords.resize(keys.size());
+    if(has_normals) chunk.normals.resize(keys.size());
+    for(size_t i = 0; i < keys.size(); i++) {
+        chunk.positions[i] = obj_lookup(chunks, keys[i].v, &ObjChunk::v, &ObjChunk::v_base);
+        if(has_texcoords) chunk.texcoords[i] = obj_lookup(chunks, keys[i].vt, &ObjChunk::vt, &ObjChunk::vt_base);
+        if(has_normals) chunk.normals[i] = obj_lookup(chunks, keys[i].vn, &ObjChunk::vn, &ObjChunk::vn_base);
+    }
+
+    chunk.material_triangles.assign(material_count, 0);
+    for(size_t r = 0; r < chunk.runs.size(); r++) {
+        if(chunk.runs[r].material >= 0) chunk.material_triangles[chunk.runs[r].material] += obj_run_end(chunk, r) - chunk.runs[r].first;
+    }
+}
+
+//Copies the chunk's vertices and writes its triangles into their material's part of the index buffer
+inline void obj_gather_chunk(ObjChunk &chunk, ObjModel &model)
+{
+    std::copy(chunk.positions.begin(), chunk.positions.end(), model.positions.begin() + chunk.vertex_base);
+    std::copy(chunk.normals.begin(), chunk.normals.end(), model.normals.begin() + chunk.vertex_base);
+    std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), model.texcoords.begin() + chunk.vertex_base);
+    for(size_t r = 0; r < chunk.runs.size(); r++) {
+        if(chunk.runs[r].material < 0) continue;
+        size_t &out = chunk.material_offsets[chunk.runs[r].material];
+        for(size_t k = chunk.runs[r].first * 3; k < obj_run_end(chunk, r) * 3; k++) {
+            model.indices[out++] = chunk.indices[k] + chunk.vertex_base;
+        }
+    }
+}
+
+//Returns false on failure. jobs may be NULL to parse on the calling thread only.
+//The chunks and their arrays come from scratch (thread safe when jobs is given), only model's arrays are kept
+inline bool load_obj(const std::string &file, ObjModel &model, JobSystem* jobs, std::pmr::memory_resource* scratch = std::pmr::get_default_resource())
+{
+    MappedFile source;
+    if(!source.open(file)) {
+        std::cerr << "Failed to read " << file << "\n";
+        return false;
+    }
+    madvise((void*)source.data, source.size, MADV_SEQUENTIAL);
+    const char* data = (const char*)source.data;
+    size_t size = source.size;
+
+    //line aligned chunks
+    size_t chunk_count = 1;
+    if(jobs != NULL && size > OBJ_CHUNK_BYTES) {
+        chunk_count = std::min(size / OBJ_CHUNK_BYTES, (size_t)jobs->thread_count() * 4);
+    }
+    std::pmr::vector<ObjChunk> chunks(scratch);
+    chunks.reserve(chunk_count);
+    for(size_t i = 0; i < chunk_count; i++) chunks.emplace_back(scratch);
+    const char* cursor = data;
+    const char* end = data + size;
+    for(size_t i = 0; i < chunk_count; i++) {
+        const char* chunk_end = i + 1 == chunk_count ? end : data + size * (i + 1) / chunk_count;
+        if(chunk_end < cursor) chunk_end = cursor;
+        while(chunk_end < end && chunk_end[-1] != '\n') chunk_end++;
+        chunks[i].begin = cursor;
+        chunks[i].end = chunk_end;
+        cursor = chunk_end;
+    }
+
+    std::function<void(int)> parse = [&chunks](int i) { obj_parse_chunk(chunks[i]); };
+    if(jobs != NULL) jobs->run(chunk_count, parse);
+    else parse(0);
+    source.close();
+
+    //material ids in the order the names are first used. Faces before the first usemtl get "default"
+    model.material_names.clear();
+    int current_material = -1;
+    size_t v_total = 0, vt_total = 0, vn_total = 0;
+    for(size_t i = 0; i < chunk_count; i++) {
+        ObjChunk &chunk = chunks[i];
+        chunk.v_base = v_total;
+        chunk.vt_base = vt_total;
+        chunk.vn_base = vn_total;
+        v_total += chunk.v.size();
+        vt_total += chunk.vt.size();
+        vn_total += chunk.vn.size();
+
+        ObjMaterialRun inherited = { 0, "", current_material };
+        chunk.runs.insert(chunk.runs.begin(), inherited);
+        for(size_t r = 0; r < chunk.runs.size(); r++) {
+            ObjMaterialRun &run = chunk.runs[r];
+            if(!run.name.empty()) run.material = obj_material_id(model.material_names, run.name);
+            else if(run.material == -1 && obj_run_end(chunk, r) > run.first) run.material = current_material = obj_material_id(model.material_names, "default");
+        }
+        current_material = chunk.runs.back().material;
+    }
+    bool has_texcoords = vt_total > 0;
+    bool has_normals = vn_total > 0;
+    size_t material_count = model.material_names.size();
+
+    std::function<void(int)> build = [&chunks, has_texcoords, has_normals, material_count](int i) { obj_build_chunk(chunks[i], chunks, has_texcoords, has_normals, material_count); };
+    if(jobs != NULL) jobs->run(chunk_count, build);
+    else build(0);
+
+    //vertices in chunk order, triangles grouped by material and in file order inside a material
+    size_t vertex_total = 0, index_total = 0;
+    for(size_t i = 0; i < chunk_count; i++) {
+        chunks[i].vertex_base = vertex_total;
+        vertex_total += chunks[i].positions.size();
+        chunks[i].material_offsets.resize(material_count);
+    }
+    model.submeshes.clear();
+    model.submeshes.reserve(material_count);
+    for(size_t m = 0; m < material_count; m++) {
+        Submesh submesh = { (GLuint)index_total, 0, (int)m };
+        for(size_t i = 0; i < chunk_count; i++) {
+            chunks[i].material_offsets[m] = index_total;
+            index_total += chunks[i].material_triangles[m] * 3;
+        }
+        submesh.index_count = index_total - submesh.first_index;
+        if(submesh.index_count > 0) model.submeshes.push_back(submesh);
+    }
+    model.positions.resize(vertex_total);
+    model.normals.resize(has_normals ? vertex_total : 0);
+    model.texcoords.resize(has_texcoords ? vertex_total : 0);
+    model.indices.reserve(index_total * 2); //room for a LOD chain (mesh_lod.h) to be appended without growing
+    model.indices.resize(index_total);
+    std::function<void(int)> gather = [&chunks, &model](int i) { obj_gather_chunk(chunks[i], model); };
+    if(jobs != NULL) jobs->run(chunk_count, gather);
+    else gather(0);
+    return true;
+}
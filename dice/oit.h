@@ -0,0 +1,210 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <iostream>
+#include <GL/glew.h>
+#include "shader.h"
+
+//Fragment outputs for the transparent pass. Weight function from McGuire & Bavoil (JCGT 2013, eq. 10),
+//fragments closer to the camera and more opaque count for more
+#define OIT_OUTPUT_GLSL \
+"layout(location = 0) out vec4 accum;" \
+"layout(location = 1) out float revealage;" \
+"void write_oit(vec4 color) {" \
+"	float weight = clamp(pow(min(1.0, color.a * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3);" \
+"	accum = vec4(color.rgb * color.a, color.a) * weight;" \
+"	revealage = color.a;" \
+"}"
+
+//Full screen triangle, no vertex buffer needed
+const char* oit_resolve_vertex_shader =
+"#version 330 core\n"
+"void main()"
+"{"
+"	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);"
+"	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);"
+"}";
+
+const char* oit_resolve_fragment_shader =
+"#version 330 core\n"
+"uniform sampler2D accum_texture;"
+"uniform sampler2D revealage_texture;"
+""
+"out vec4 color;"
+""
+"void main()"
+"{"
+"	ivec2 texel = ivec2(gl_FragCoord.xy);"
+"	float revealage = texelFetch(revealage_texture, texel, 0).r;"
+"	if(revealage == 1.0) discard;" //nothing transparent here
+"	vec4 accum = texelFetch(accum_texture, texel, 0);"
+"	color = vec4(accum.rgb / max(accum.a, 1e-5), 1.0 - revealage);"
+"}";
+
+//Weighted blended order independent transparency. Opaque geometry is drawn into an offscreen target,
+//transparent surfaces are summed into an accumulation (RGBA16F) and a revealage (R8) target that share its depth
+//buffer, and one full screen pass composites the average over the opaque image. No sorting, any draw order
+//gives the same result. Needs per target blend functions (GL 4.0 or ARB_draw_buffers_blend).
+class WeightedBlendedOIT
+{
+    public:
+    bool supported = false;
+
+    bool init()
+    {
+        supported = GLEW_VERSION_4_0 || GLEW_ARB_draw_buffers_blend;
+        if(!supported) {
+            return true;
+        }
+        if(!resolve_shader.build(oit_resolve_vertex_shader, oit_resolve_fragment_shader)) {
+            return false;
+        }
+        glUseProgram(resolve_shader.id);
+        glUniform1i(resolve_shader.uniform("accum_texture"), 0);
+        glUniform1i(resolve_shader.uniform("revealage_texture"), 1);
+        glGenVertexArrays(1, &empty_vao);
+        return true;
+    }
+
+    //(Re)creates the targets when the framebuffer size changes
+    bool resize(int new_width, int new_height)
+    {
+        if(!supported || (new_width == width && new_height == height)) {
+            return true;
+        }
+        destroy_targets();
+        width = new_width;
+        height = new_height;
+
+        opaque_texture = make_texture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        accum_texture = make_texture(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT);
+        revealage_texture = make_texture(GL_R8, GL_RED, GL_UNSIGNED_BYTE);
+        glGenRenderbuffers(1, &depth_buffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+        glGenFramebuffers(1, &opaque_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, opaque_fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, opaque_texture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+        glGenFramebuffers(1, &transparent_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, transparent_fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accum_texture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, revealage_texture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+        GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, buffers);
+        complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if(!complete) {
+            std::cerr << "OIT framebuffer incomplete." << std::endl;
+            width = height = 0; //so the next resize tries again instead of reporting success
+        }
+        return complete;
+    }
+
+    //Opaque geometry goes to the offscreen target
+    void begin_opaque()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, opaque_fbo);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    //Depth is tested against the opaque pass but not written, accum is a sum and revealage a product
+    void begin_transparent()
+    {
+        const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const GLfloat one[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glBindFramebuffer(GL_FRAMEBUFFER, transparent_fbo);
+        glClearBufferfv(GL_COLOR, 0, zero);
+        glClearBufferfv(GL_COLOR, 1, one);
+        glDepthMask(GL_FALSE);
+        if(GLEW_VERSION_4_0) {
+            glBlendFunci(0, GL_ONE, GL_ONE);
+            glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+        } else {
+            glBlendFunciARB(0, GL_ONE, GL_ONE);
+            glBlendFunciARB(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+        }
+    }
+
+    //Composites the transparent average over the opaque image and copies the result to the window
+    void resolve()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, opaque_fbo);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_DEPTH_TEST);
+        glUseProgram(resolve_shader.id);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, accum_texture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, revealage_texture);
+        glBindVertexArray(empty_vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glEnable(GL_DEPTH_TEST);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, opaque_fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void destroy()
+    {
+        destroy_targets();
+        if(supported) {
+            glDeleteVertexArrays(1, &empty_vao);
+            resolve_shader.destroy();
+        }
+    }
+
+    private:
+    ShaderProgram resolve_shader;
+    GLuint empty_vao = 0;
+    GLuint opaque_fbo = 0;
+    GLuint transparent_fbo = 0;
+    GLuint opaque_texture = 0;
+    GLuint accum_texture = 0;
+    GLuint revealage_texture = 0;
+    GLuint depth_buffer = 0;
+    int width = 0;
+    int height = 0;
+
+    GLuint make_texture(GLint internal_format, GLenum format, GLenum type)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    void destroy_targets()
+    {
+        if(opaque_fbo == 0) {
+            return;
+        }
+        glDeleteFramebuffers(1, &opaque_fbo);
+        glDeleteFramebuffers(1, &transparent_fbo);
+        glDeleteTextures(1, &opaque_texture);
+        glDeleteTextures(1, &accum_texture);
+        glDeleteTextures(1, &revealage_texture);
+        glDeleteRenderbuffers(1, &depth_buffer);
+        opaque_fbo = transparent_fbo = opaque_texture = accum_texture = revealage_texture = depth_buffer = 0;
+        width = height = 0;
+    }
+};
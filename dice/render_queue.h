@@ -0,0 +1,209 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <GL/glew.h>
+#include "mesh_pool.h"
+
+//Passes run in this order, the pass is the top of the sort key
+enum RenderPass
+{
+    PASS_BACKGROUND,
+    PASS_OPAQUE,
+    PASS_TRANSPARENT
+};
+
+enum CullMode
+{
+    CULL_NONE,
+    CULL_FRONT,
+    CULL_BACK
+};
+
+//Everything a draw needs. texture 0 means the draw doesn't sample one, whatever is bound stays bound
+struct RenderItem
+{
+    int pass;
+    GLuint program;
+    GLuint texture;       //GL_TEXTURE_CUBE_MAP on unit 0
+    GLuint vao;
+    bool depth_write;
+    int cull;
+    GLuint first_command; //into the mesh pool command buffer
+    GLsizei command_count;
+    float depth;          //view distance of the item, 0 = near plane
+    int order;            //tie break inside the same depth (e.g. back faces before front faces)
+};
+
+//Per frame list of draws, sorted by a packed 64 bit key and submitted with redundant state changes filtered out.
+//Key layout, high to low bits:
+//  opaque/background: pass 4 | program 8 | texture 12 | vao 8 | depth 24 (front to back) | order 8
+//  transparent:       pass 4 | depth 24 (back to front) | program 8 | texture 12 | vao 8 | order 8
+//so opaque draws group by state and transparent ones keep the blending order.
+//The state ids are the order the GL names were first added in this frame, so they stay small while textures come and go.
+//Past the field width the extra names share the last id, which only loosens their grouping, submit compares the real names.
+//Consecutive items with the same state and adjacent commands become one multi draw.
+class RenderQueue
+{
+    public:
+    //Per frame counters, the caller resets them
+    long state_changes = 0;
+    long state_changes_avoided = 0;
+    long merged_draws = 0;
+
+    void clear()
+    {
+        items.clear();
+        sorted.clear();
+        programs.clear();
+        textures.clear();
+        vaos.clear();
+    }
+
+    //depth_range is the far end of the depth values (far plane distance) used to quantize depth
+    void add(const RenderItem &item, float depth_range)
+    {
+        uint64_t depth = quantize_depth(item.depth, depth_range);
+        uint64_t program = small_id(programs, item.program, 0x100);
+        uint64_t texture = small_id(textures, item.texture, 0x1000);
+        uint64_t vao = small_id(vaos, item.vao, 0x100);
+        uint64_t order = (uint64_t)item.order & 0xff;
+        uint64_t key = (uint64_t)item.pass << 60;
+        if(item.pass == PASS_TRANSPARENT) {
+            key |= ((0xffffff - depth) << 36) | (program << 28) | (texture << 16) | (vao << 8) | order;
+        } else {
+            key |= (program << 52) | (texture << 40) | (vao << 32) | (depth << 8) | order;
+        }
+        SortEntry entry = { key, (uint32_t)items.size() };
+        sorted.push_back(entry);
+        items.push_back(item);
+    }
+
+    //LSD radix sort, 8 bits per pass. Passes where every key has the same byte are skipped
+    void sort()
+    {
+        scratch.resize(sorted.size());
+        for(int shift = 0; shift < 64; shift += 8) {
+            size_t counts[256] = {};
+            for(size_t i = 0; i < sorted.size(); i++) {
+                counts[(sorted[i].key >> shift) & 0xff]++;
+            }
+            if(sorted.empty() || counts[(sorted[0].key >> shift) & 0xff] == sorted.size()) {
+                continue;
+            }
+            size_t offset = 0;
+            for(int b = 0; b < 256; b++) {
+                size_t count = counts[b];
+                counts[b] = offset;
+                offset += count;
+            }
+            for(size_t i = 0; i < sorted.size(); i++) {
+                scratch[counts[(sorted[i].key >> shift) & 0xff]++] = sorted[i];
+            }
+            sorted.swap(scratch);
+        }
+    }
+
+    //Draws the sorted items of passes [first_pass, last_pass]. GL state is assumed unknown at the start of every call
+    void submit(MeshPool &pool, int first_pass, int last_pass)
+    {
+        GLuint program = 0;
+        GLuint texture = 0;
+        GLuint vao = 0;
+        int depth_write = -1;
+        int cull = -1;
+        bool first = true;
+        size_t i = 0;
+        while(i < sorted.size()) {
+            const RenderItem &item = items[sorted[i].item];
+            if(item.pass < first_pass || item.pass > last_pass) {
+                i++;
+                continue;
+            }
+            if(count(first || item.program != program)) glUseProgram(item.program);
+            if(item.texture != 0 && count(texture == 0 || item.texture != texture)) glBindTexture(GL_TEXTURE_CUBE_MAP, item.texture);
+            if(count(first || item.vao != vao)) glBindVertexArray(item.vao);
+            if(count(first || (int)item.depth_write != depth_write)) glDepthMask(item.depth_write ? GL_TRUE : GL_FALSE);
+            if(count(first || item.cull != cull)) set_cull(item.cull);
+            program = item.program;
+            if(item.texture != 0) texture = item.texture;
+            vao = item.vao;
+            depth_write = item.depth_write;
+            cull = item.cull;
+            first = false;
+
+            //extend over the following items that need the same state and continue the command range
+            GLuint command_end = item.first_command + item.command_count;
+            size_t next = i + 1;
+            while(next < sorted.size()) {
+                const RenderItem &other = items[sorted[next].item];
+                if(other.pass != item.pass || other.program != item.program || other.texture != item.texture || other.vao != item.vao
+                    || other.depth_write != item.depth_write || other.cull != item.cull || other.first_command != command_end) {
+                    break;
+                }
+                command_end += other.command_count;
+                merged_draws++;
+                next++;
+            }
+            pool.draw(item.first_command, command_end - item.first_command, false);
+            i = next;
+        }
+        set_cull(CULL_NONE);
+        glDepthMask(GL_TRUE);
+    }
+
+    private:
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t item;
+    };
+    std::vector<RenderItem> items;
+    std::vector<SortEntry> sorted;
+    std::vector<SortEntry> scratch;
+    //GL names seen this frame, their position is the id packed in the key
+    std::vector<GLuint> programs;
+    std::vector<GLuint> textures;
+    std::vector<GLuint> vaos;
+
+    //limit is the number of ids the key field holds, once they are used up every new name gets the last one
+    static uint64_t small_id(std::vector<GLuint> &names, GLuint name, size_t limit)
+    {
+        for(size_t i = 0; i < names.size(); i++) {
+            if(names[i] == name) return i;
+        }
+        if(names.size() == limit) return limit - 1;
+        names.push_back(name);
+        return names.size() - 1;
+    }
+
+    static uint64_t quantize_depth(float depth, float depth_range)
+    {
+        float normalized = depth / depth_range;
+        if(normalized < 0.0f) normalized = 0.0f;
+        if(normalized > 1.0f) normalized = 1.0f;
+        return (uint64_t)(normalized * 0xffffff);
+    }
+
+    bool count(bool changed)
+    {
+        if(changed) state_changes++;
+        else state_changes_avoided++;
+        return changed;
+    }
+
+    static void set_cull(int cull)
+    {
+        if(cull == CULL_NONE) {
+            glDisable(GL_CULL_FACE);
+            return;
+        }
+        glEnable(GL_CULL_FACE);
+        glCullFace(cull == CULL_FRONT ? GL_FRONT : GL_BACK);
+    }
+};
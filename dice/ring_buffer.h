@@ -0,0 +1,125 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <vector>
+#include <string.h>
+#include <GL/glew.h>
+
+//Triple buffered stream buffer for data rewritten every frame. With GL 4.4 / ARB_buffer_storage it is mapped
+//once (persistent + coherent) and the CPU writes straight into the slice of the current frame, without
+//glBufferSubData copies. A fence per slice keeps the CPU from overwriting a slice the GPU is still reading;
+//having to wait on one counts as a stall. Without buffer storage writes go to a staging copy that flush()
+//sends with glBufferSubData.
+class StreamRing
+{
+    public:
+    static const int SLICES = 3;
+    GLuint buffer = 0;
+    bool persistent = false;
+    long stalls = 0;
+
+    void create(GLenum buffer_target, size_t bytes_per_frame)
+    {
+        target = buffer_target;
+        GLint alignment = 256;
+        if(target == GL_UNIFORM_BUFFER) {
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        }
+        slice_size = (bytes_per_frame + alignment - 1) / alignment * alignment;
+        persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        if(persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(target, slice_size * SLICES, NULL, flags);
+            mapped = (unsigned char*)glMapBufferRange(target, 0, slice_size * SLICES, flags);
+        } else {
+            glBufferData(target, slice_size * SLICES, NULL, GL_STREAM_DRAW);
+            staging.resize(slice_size);
+        }
+    }
+
+    //Moves to the next slice, waiting for the GPU if it is still using it
+    void begin_frame()
+    {
+        slice = (slice + 1) % SLICES;
+        written = 0;
+        if(fences[slice] == 0) {
+            return;
+        }
+        if(glClientWaitSync(fences[slice], 0, 0) == GL_TIMEOUT_EXPIRED) {
+            stalls++;
+            while(glClientWaitSync(fences[slice], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fences[slice]);
+        fences[slice] = 0;
+    }
+
+    //Where this frame's data goes, valid until end_frame()
+    unsigned char* data() { return persistent ? mapped + slice * slice_size : &staging[0]; }
+    //Offset of this frame's slice in the buffer, for attribute pointers and glBindBufferRange
+    size_t offset() const { return slice * slice_size; }
+    size_t capacity() const { return slice_size; }
+
+    void write(size_t slice_offset, const void* source, size_t bytes)
+    {
+        memcpy(data() + slice_offset, source, bytes);
+        mark_written(slice_offset + bytes);
+    }
+
+    //For callers that wrote through data() themselves
+    void mark_written(size_t end)
+    {
+        if(end > written) written = end;
+    }
+
+    //Only does something without persistent mapping
+    void flush()
+    {
+        if(persistent || written == 0) {
+            return;
+        }
+        glBindBuffer(target, buffer);
+        glBufferSubData(target, offset(), written, &staging[0]);
+        written = 0;
+    }
+
+    //After the last draw that reads this frame's slice
+    void end_frame()
+    {
+        flush();
+        fences[slice] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    void destroy()
+    {
+        for(int i = 0; i < SLICES; i++) {
+            if(fences[i] != 0) glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+        if(buffer == 0) {
+            return;
+        }
+        if(persistent) {
+            glBindBuffer(target, buffer);
+            glUnmapBuffer(target);
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        mapped = NULL;
+    }
+
+    private:
+    GLenum target = GL_ARRAY_BUFFER;
+    size_t slice_size = 0;
+    int slice = 0;
+    size_t written = 0;
+    unsigned char* mapped = NULL;
+    std::vector<unsigned char> staging;
+    GLsync fences[SLICES] = {};
+};
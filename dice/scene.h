@@ -0,0 +1,102 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <vector>
+#include <climits>
+#include "glm/glm.hpp"
+
+//Flat scene graph. Nodes are stored in topological order (a parent is always added
+//before its children) so a single forward pass over the arrays is enough to bring
+//every world matrix up to date. Only the subtrees below a changed node are recomputed.
+class SceneGraph
+{
+    public:
+    static const int NO_PARENT = -1;
+
+    int add_node(int parent, const glm::mat4 &local)
+    {
+        int node = (int)parents.size();
+        parents.push_back(parent);
+        locals.push_back(local);
+        worlds.push_back(local);
+        dirty.push_back(1);
+        if(node < first_dirty) first_dirty = node;
+        return node;
+    }
+
+    void set_local(int node, const glm::mat4 &local)
+    {
+        locals[node] = local;
+        mark_dirty(node);
+    }
+
+    //Applies m on top of the node's current local transform (local = m * local)
+    void transform(int node, const glm::mat4 &m)
+    {
+        locals[node] = m * locals[node];
+        mark_dirty(node);
+    }
+
+    const glm::mat4 &local(int node) const { return locals[node]; }
+    const glm::mat4 &world(int node) const { return worlds[node]; }
+    //Nodes added one after the other have contiguous world matrices, ready to be uploaded as is
+    const glm::mat4* world_array(int first_node) const { return &worlds[first_node]; }
+    int size() const { return (int)parents.size(); }
+
+    //Recomputes the world matrix of every dirty node and of everything below it.
+    //Returns false when nothing was dirty
+    bool update()
+    {
+        if(!begin_update()) {
+            return false;
+        }
+        update_range(0, size());
+        end_update();
+        return true;
+    }
+
+    //The same update split up so disjoint subtrees can be done on different threads:
+    //begin_update(), then update_range() over ranges whose parents are already up to date
+    //(earlier in the same range or done by an earlier call), then end_update()
+    bool begin_update() const { return first_dirty != INT_MAX; }
+
+    void update_range(int first, int last)
+    {
+        for(int i = first > first_dirty ? first : first_dirty; i < last; i++) {
+            int parent = parents[i];
+            if(parent != NO_PARENT && dirty[parent]) {
+                dirty[i] = 1;
+            }
+            if(dirty[i]) {
+                worlds[i] = parent == NO_PARENT ? locals[i] : worlds[parent] * locals[i];
+            }
+        }
+    }
+
+    //flags are cleared in a second pass, children needed to see their parent's flag
+    void end_update()
+    {
+        int count = size();
+        for(int i = first_dirty; i < count; i++) {
+            dirty[i] = 0;
+        }
+        first_dirty = INT_MAX;
+    }
+
+    private:
+    std::vector<int> parents;
+    std::vector<glm::mat4> locals;
+    std::vector<glm::mat4> worlds;
+    std::vector<unsigned char> dirty;
+    int first_dirty = INT_MAX; //lowest dirty node, nothing to do while it is INT_MAX
+
+    void mark_dirty(int node)
+    {
+        dirty[node] = 1;
+        if(node < first_dirty) first_dirty = node;
+    }
+};
@@ -0,0 +1,154 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <iostream>
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+//Compiles and links a vertex + fragment shader pair and reflects every active uniform
+//and attribute once at link time, so draws never go through glGetUniformLocation again
+class ShaderProgram
+{
+    public:
+    GLuint id = 0;
+
+    bool build(const char* vertex_source, const char* fragment_source)
+    {
+        vs = compile(GL_VERTEX_SHADER, vertex_source);
+        fs = compile(GL_FRAGMENT_SHADER, fragment_source);
+        if(vs == 0 || fs == 0) {
+            destroy();
+            return false;
+        }
+        id = glCreateProgram();
+        glAttachShader(id, vs);
+        glAttachShader(id, fs);
+        glLinkProgram(id);
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(id, GL_LINK_STATUS, &linked);
+        if(linked != GL_TRUE) {
+            char log[1024];
+            glGetProgramInfoLog(id, sizeof(log), NULL, log);
+            std::cerr << "Shader program link failed:\n" << log << "\n";
+            destroy();
+            return false;
+        }
+        reflect();
+        return true;
+    }
+
+    //-1 when the uniform is not active, same as glGetUniformLocation
+    GLint uniform(const std::string &name) const
+    {
+        std::map<std::string, GLint>::const_iterator it = uniforms.find(name);
+        return it == uniforms.end() ? -1 : it->second;
+    }
+
+    GLint attribute(const std::string &name) const
+    {
+        std::map<std::string, GLint>::const_iterator it = attributes.find(name);
+        return it == attributes.end() ? -1 : it->second;
+    }
+
+    //Ties a named uniform block to a buffer binding point, no-op if the program doesn't use it
+    void bind_uniform_block(const char* name, GLuint binding)
+    {
+        GLuint index = glGetUniformBlockIndex(id, name);
+        if(index != GL_INVALID_INDEX) {
+            glUniformBlockBinding(id, index, binding);
+        }
+    }
+
+    void destroy()
+    {
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        glDeleteProgram(id);
+        vs = fs = id = 0;
+    }
+
+    private:
+    GLuint vs = 0;
+    GLuint fs = 0;
+    std::map<std::string, GLint> uniforms;
+    std::map<std::string, GLint> attributes;
+
+    static GLuint compile(GLenum type, const char* source)
+    {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+
+        GLint compiled = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if(compiled != GL_TRUE) {
+            char log[1024];
+            glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+            std::cerr << (type == GL_VERTEX_SHADER ? "Vertex" : "Fragment") << " shader compilation failed:\n" << log << "\n";
+            glDeleteShader(shader);
+            return 0;
+        }
+        return shader;
+    }
+
+    //Arrays are reported as "name[0]", store them under the plain name as well
+    static std::string base_name(const char* name)
+    {
+        std::string s(name);
+        size_t bracket = s.find('[');
+        return bracket == std::string::npos ? s : s.substr(0, bracket);
+    }
+
+    void reflect()
+    {
+        GLint count = 0;
+        char name[256];
+        GLsizei length;
+        GLint size;
+        GLenum type;
+
+        glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+        for(GLint i = 0; i < count; i++) {
+            glGetActiveUniform(id, i, sizeof(name), &length, &size, &type, name);
+            GLint location = glGetUniformLocation(id, name);
+            if(location == -1) { //lives in a uniform block, set through the buffer instead
+                continue;
+            }
+            uniforms[name] = location;
+            uniforms[base_name(name)] = location;
+        }
+
+        glGetProgramiv(id, GL_ACTIVE_ATTRIBUTES, &count);
+        for(GLint i = 0; i < count; i++) {
+            glGetActiveAttrib(id, i, sizeof(name), &length, &size, &type, name);
+            attributes[name] = glGetAttribLocation(id, name);
+        }
+    }
+};
+
+//Matches the std140 "Camera" block declared in the shaders. mat4 and vec4 members
+//are already 16 byte aligned so the C++ layout is the std140 layout
+struct CameraBlock
+{
+    glm::mat4 projection_matrix;
+    glm::mat4 view_matrix;
+    glm::mat4 skybox_view_matrix;
+    glm::vec4 camera_position;
+};
+
+const GLuint CAMERA_BLOCK_BINDING = 0;
+
+#define CAMERA_BLOCK_GLSL \
+"layout(std140) uniform Camera {" \
+"	mat4 projection_matrix;" \
+"	mat4 view_matrix;" \
+"	mat4 skybox_view_matrix;" \
+"	vec4 camera_position;" \
+"};"
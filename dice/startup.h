@@ -0,0 +1,147 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <condition_variable>
+
+const int TIMELINE_COLUMNS = 50;
+
+//When each startup job ran, on which thread, and when the GL thread uploaded its result.
+//Jobs report started/finished from any thread, the GL thread picks finished ones up in order of completion
+//with next_finished(), so it can upload each result as soon as it is ready
+class StartupTimeline
+{
+    public:
+    StartupTimeline() : origin(std::chrono::steady_clock::now()), main_thread(std::this_thread::get_id()) {}
+
+    //Every job has to be added before the job threads start on any of them
+    int add(const std::string &name)
+    {
+        Job job;
+        job.name = name;
+        jobs.push_back(job);
+        return jobs.size() - 1;
+    }
+
+    double now_ms() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void started(int job)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs[job].start = now_ms();
+        jobs[job].thread = std::this_thread::get_id();
+    }
+
+    void finished(int job, bool ok)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs[job].end = now_ms();
+            jobs[job].ok = ok;
+            completed.push_back(job);
+        }
+        ready.notify_one();
+    }
+
+    //Blocks until a job finishes that wasn't returned yet, -1 once all of them were
+    int next_finished()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(returned == jobs.size()) return -1;
+        ready.wait(lock, [this] { return completed.size() > returned; });
+        return completed[returned++];
+    }
+
+    double duration_ms(int job)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return jobs[job].end - jobs[job].start;
+    }
+
+    bool ok(int job)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return jobs[job].ok;
+    }
+
+    //GL thread side, upload_start is a now_ms() from before the upload
+    void uploaded(int job, double upload_start)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs[job].upload_start = upload_start;
+        jobs[job].upload_end = now_ms();
+    }
+
+    //One line per job in start order: thread, start, end, upload, and a bar ('#' running, '=' uploading).
+    //The job that was uploaded last is the critical path
+    void print()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::thread::id> threads(1, main_thread);
+        double total = 0.0;
+        size_t critical = 0;
+        for(size_t j = 0; j < jobs.size(); j++) {
+            if(std::find(threads.begin(), threads.end(), jobs[j].thread) == threads.end()) threads.push_back(jobs[j].thread);
+            if(std::max(jobs[j].end, jobs[j].upload_end) > total) {
+                total = std::max(jobs[j].end, jobs[j].upload_end);
+                critical = j;
+            }
+        }
+        std::vector<size_t> order(jobs.size());
+        for(size_t j = 0; j < order.size(); j++) order[j] = j;
+        std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return jobs[a].start < jobs[b].start; });
+
+        std::ios::fmtflags flags = std::cout.flags();
+        std::cout << "Startup timeline (ms):\n" << std::fixed << std::setprecision(1);
+        for(size_t o = 0; o < order.size(); o++) {
+            const Job &job = jobs[order[o]];
+            int thread = std::find(threads.begin(), threads.end(), job.thread) - threads.begin();
+            std::string bar(TIMELINE_COLUMNS, ' ');
+            for(int c = 0; total > 0.0 && c < TIMELINE_COLUMNS; c++) {
+                double t = (c + 0.5) * total / TIMELINE_COLUMNS;
+                if(t >= job.start && t < job.end) bar[c] = '#';
+                if(t >= job.upload_start && t < job.upload_end) bar[c] = '=';
+            }
+            std::string thread_name = thread == 0 ? "main" : "worker " + std::to_string(thread);
+            std::cout << "    " << std::left << std::setw(20) << job.name << std::setw(10) << thread_name << std::right
+                << std::setw(8) << job.start << std::setw(8) << job.end;
+            if(job.upload_end > 0.0) std::cout << std::setw(8) << job.upload_start << std::setw(8) << job.upload_end;
+            else std::cout << std::setw(16) << "-";
+            std::cout << "  |" << bar << "|" << (order[o] == critical ? " critical" : "") << "\n";
+        }
+        std::cout << "Startup loading done at " << total << " ms\n";
+        std::cout.flags(flags);
+    }
+
+    private:
+    struct Job
+    {
+        std::string name;
+        std::thread::id thread;
+        double start = 0.0, end = 0.0;
+        double upload_start = 0.0, upload_end = 0.0;
+        bool ok = false;
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    std::thread::id main_thread;
+    std::vector<Job> jobs;
+    std::vector<int> completed;
+    size_t returned = 0;
+    std::mutex mutex;
+    std::condition_variable ready;
+};
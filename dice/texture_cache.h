@@ -0,0 +1,115 @@
+/*
+ * By Guilherme Serpa, 82078
+ *
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+//GPU size of a cubemap: every face of every level there is, compressed or not
+inline size_t cubemap_bytes(GLuint texture)
+{
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+    size_t bytes = 0;
+    for(int face = 0; face < 6; face++) {
+        for(int level = 0; level < 16; level++) {
+            GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
+            GLint width = 0, height = 0, compressed = 0, format = 0;
+            glGetTexLevelParameteriv(target, level, GL_TEXTURE_WIDTH, &width);
+            if(width == 0) break;
+            glGetTexLevelParameteriv(target, level, GL_TEXTURE_HEIGHT, &height);
+            glGetTexLevelParameteriv(target, level, GL_TEXTURE_COMPRESSED, &compressed);
+            if(compressed) {
+                GLint size = 0;
+                glGetTexLevelParameteriv(target, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+                bytes += size;
+                continue;
+            }
+            glGetTexLevelParameteriv(target, level, GL_TEXTURE_INTERNAL_FORMAT, &format);
+            //RGB formats are padded to 4 bytes per texel by the drivers, so only the 1 and 2 channel ones are smaller
+            int texel_bytes = format == GL_R8 ? 1 : format == GL_RG8 ? 2 : 4;
+            bytes += (size_t)width * height * texel_bytes;
+        }
+    }
+    return bytes;
+}
+
+//Cubemaps kept on the GPU by source (the skybox directory), so switching back to one is only a lookup.
+//When the resident ones go over budget the least recently used are deleted, never the one just added or the one in use
+class CubemapCache
+{
+    public:
+    size_t budget = 0;
+    size_t resident_bytes = 0;
+    long hits = 0;
+    long misses = 0;
+    long evictions = 0;
+
+    //0 when it isn't resident, otherwise it is now the most recently used
+    GLuint find(const std::string &key)
+    {
+        for(size_t i = 0; i < entries.size(); i++) {
+            if(entries[i].key == key) {
+                entries[i].last_used = ++clock;
+                hits++;
+                return entries[i].texture;
+            }
+        }
+        misses++;
+        return 0;
+    }
+
+    //Doesn't count as a hit or a miss
+    bool resident(const std::string &key) const
+    {
+        for(size_t i = 0; i < entries.size(); i++) {
+            if(entries[i].key == key) return true;
+        }
+        return false;
+    }
+
+    //in_use is never evicted either (e.g. the skybox on screen while another one is prefetched)
+    void insert(const std::string &key, GLuint texture, GLuint in_use = 0)
+    {
+        Entry entry = { key, texture, cubemap_bytes(texture), ++clock };
+        entries.push_back(entry);
+        resident_bytes += entry.bytes;
+        while(resident_bytes > budget) {
+            size_t oldest = entries.size();
+            for(size_t i = 0; i + 1 < entries.size(); i++) {
+                if(entries[i].texture == in_use) continue;
+                if(oldest == entries.size() || entries[i].last_used < entries[oldest].last_used) oldest = i;
+            }
+            if(oldest == entries.size()) break;
+            glDeleteTextures(1, &entries[oldest].texture);
+            resident_bytes -= entries[oldest].bytes;
+            entries.erase(entries.begin() + oldest);
+            evictions++;
+        }
+    }
+
+    size_t resident_count() const { return entries.size(); }
+
+    void destroy()
+    {
+        for(size_t i = 0; i < entries.size(); i++) {
+            glDeleteTextures(1, &entries[i].texture);
+        }
+        entries.clear();
+        resident_bytes = 0;
+    }
+
+    private:
+    struct Entry
+    {
+        std::string key;
+        GLuint texture;
+        size_t bytes;
+        unsigned long last_used;
+    };
+    std::vector<Entry> entries;
+    unsigned long clock = 0;
+};